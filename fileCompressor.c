@@ -10,80 +10,539 @@
 #include <dirent.h>
 #include <limits.h>
 #include <time.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 #define TRUE 1
 #define FALSE 0
 
-//node struct which comprise our hashtable tree
-struct node{
-  //identify what type of node we are dealing with 0->parent 1->leaf
-  int identifier;
-  //pointer to the next node in the given linked list
-  struct node * next;
-  //the key (token) of the specific node
-  char * myKey;
-  //the value (frequency) of the specific node (token)
-  int frequency;
-  //this is the huffman parent node
-  struct node * rChild;
-  struct node * lChild;
+//every .hcz file starts with this magic string followed by a version byte
+#define HCZ_MAGIC "HCZ"
+//version of the packed bitstream format
+#define HCZ_VERSION 1
+//magic + version + the number of valid bits in the last byte
+#define HCZ_HEADER_SIZE 5
+//version of .hcz files split into blocks, after the header every block is framed by its bit length
+#define HCZ_BLOCK_VERSION 2
+//size of the bit length in front of every block
+#define HCZ_FRAME_SIZE 8
+//bit length that marks the end of the blocks
+#define HCZ_END_FRAME 0xFFFFFFFFFFFFFFFFULL
+//block files end with an index of their blocks and a footer saying where it is
+#define HCZ_INDEX_MAGIC "HCZI"
+//every block has its frame offset, bit length and decompressed size in the index
+#define HCZ_INDEX_ENTRY 24
+//the footer holds the number of blocks, the offset of the index and the magic
+#define HCZ_FOOTER_SIZE 20
+//size of the reusable buffers used to read and write files in bulk
+#define IO_BUFFER_SIZE 65536
+//size of the chunks files are streamed in, tokens that don't fit in one chunk make the buffer grow
+#define CHUNK_SIZE 65536
+//strings owned by an arena are packed into blocks of this size
+#define ARENA_BLOCK_SIZE 65536
+//number of bytes the delimiter scanner checks at once, one bit of the mask per byte
+#define SCAN_BLOCK 32
+//longest code a codebook build may hand out unless -L asks for less, so every code fits in a machine word
+#define MAX_CODE_LENGTH 32
+//binary codebooks start with this magic string
+#define HCB_MAGIC "HCB1"
+//frequency files start with this magic string
+#define HCF_MAGIC "HCF1"
+//every token of a frequency file starts with its length (4 bytes) and its count (8 bytes)
+#define HCF_RECORD_SIZE 12
+//number of bits the decoder peeks at once for its first table lookup
+#define DECODE_BITS 11
+//types of entries in the decode tables
+#define DECODE_EMPTY 0
+#define DECODE_SYMBOL 1
+#define DECODE_LINK 2
+//the raw key of the escape code in the tables, it holds delimiters so no real token can ever look like it
+#define ESCAPE_TOKEN "\n\t"
+//the bytes we expect a sketch token to take on the heap, used to turn a memory budget into a number of counters
+#define SKETCH_TOKEN_BYTES 32
+//the least a vocabulary may take before it is spilled, so even a small share of -s holds a few thousand tokens per run
+#define MIN_SPILL_BUDGET 262144
+
+//a token of the vocabulary on its way into the huffman construction
+struct leaf{
+  //the frequency and hash of the token, the leaves are sorted by both
+  long value;
+  uint32_t hash;
+  //the token, kept in the vocabulary or in the token file of a spilled build
+  char * key;
+};
+
+//packs bits into bytes before they get written to a .hcz file
+struct bitWriter{
+  //the file descriptor of the .hcz file
+  int fd;
+  //holds the bits that have not made a whole byte yet at the bottom of the register
+  unsigned long long acc;
+  //the number of bits waiting in acc
+  int count;
+  //packed bytes waiting to be written and how much of the buffer they use
+  unsigned char * buff;
+  int used;
+  //the number of whole bytes packed so far, header included
+  long bytes;
+  //with no file (fd -1) the packed bytes are collected here instead
+  unsigned char * mem;
+  long memUsed;
+  long memCap;
+};
+
+//a piece of a file that is coded on its own so blocks can be compressed in parallel
+struct hczBlock{
+  //the text of the block, it always ends right after a delimiter (or at the end of the file)
+  const char * start;
+  long length;
+  //the packed codes and the number of valid bits in them
+  unsigned char * out;
+  long outSize;
+  unsigned long long bitLength;
+  //set once the block is coded
+  int done;
+};
+
+//the blocks of one file the compression threads share, they are written out in order as they finish
+struct blockJob{
+  struct hczBlock * blocks;
+  //the number of blocks and the next one to code
+  int count;
+  int next;
+  //the number of blocks written out so far, blocks are only coded this far ahead of the writer
+  int written;
+  int window;
+  pthread_mutex_t lock;
+  //signalled every time a block is done or written
+  pthread_cond_t finished;
+};
+
+//pulls bits out of a .hcz file most significant bit first
+struct bitReader{
+  //the file descriptor of the .hcz file
+  int fd;
+  //holds the next bits of the stream aligned to the top of the register
+  unsigned long long acc;
+  //the number of bits loaded into acc
+  int count;
+  //the number of valid code bits that have not been consumed yet
+  long bitsLeft;
+  //the number of bytes of the file that have not been loaded yet
+  long bytesLeft;
+  //bytes read from the file in bulk that have not been loaded into acc
+  unsigned char * buff;
+  //position of the next byte and the number of bytes in buff
+  int buffPos;
+  int buffUsed;
+};
+
+//collects output bytes so they can be written in large blocks
+struct byteWriter{
+  //the file descriptor we are writing to
+  int fd;
+  //the buffer and how much of it is used
+  char * buff;
+  int used;
+  //where in the file the next bytes go, -1 just appends them with write
+  long offset;
+};
+
+//the blocks of one indexed .hcz file the decompression threads share
+struct decodeJob{
+  //the mapped .hcz file and its index
+  const unsigned char * map;
+  const unsigned char * index;
+  //where the text of every block starts in the output
+  long * outOffsets;
+  //the number of blocks and the next one to decode
+  int count;
+  int next;
+  pthread_mutex_t lock;
+  //the file we're writing to and whether any block failed
+  int writeFD;
+  int failed;
+};
+
+//one slot of the table driven decoder
+struct decodeEntry{
+  //symbol index for DECODE_SYMBOL, index of the sub table for DECODE_LINK
+  int value;
+  //bits consumed by the symbol, or bits used to index the sub table
+  unsigned char bits;
+  //DECODE_EMPTY, DECODE_SYMBOL or DECODE_LINK
+  unsigned char type;
+};
+
+//the decompression side of the codebook
+struct decoder{
+  //all of the decode tables, the root table starts at 0
+  struct decodeEntry * table;
+  //used and allocated entries of the tables
+  int used;
+  int cap;
+  //number of bits used to index the root table
+  int rootBits;
+  //the tokens, their lengths and their bitcodes (the low codeLens bits of every code)
+  char ** symbols;
+  int * symbolLens;
+  unsigned long long * codes;
+  unsigned char * codeLens;
+  //used and allocated symbols
+  int numSymbols;
+  int symCap;
+  //the symbol index of the escape code, -1 if the codebook has none
+  int escape;
+};
+
+//tokens and their code lengths in the order their canonical codes are handed out
+struct canonList{
+  //the tokens
+  char ** tokens;
+  //the code length of every token
+  int * lengths;
+  //the frequency of every token (only known when building)
+  long * weights;
+  //used and allocated entries
+  int count;
+  int cap;
+};
+
+//the header at the start of a binary codebook, the arrays follow it in this order:
+//offsets[count+1], codes[count], lengths[count] (padded to 4 bytes), index[indexSize], pool[poolSize]
+struct binaryHeader{
+  //HCB_MAGIC
+  char magic[4];
+  //number of tokens, sorted by code length and then by token
+  uint32_t count;
+  //bytes in the string pool
+  uint32_t poolSize;
+  //slots in the hash index, always a power of two
+  uint32_t indexSize;
+  //the longest code
+  uint32_t maxLength;
+};
+
+//the header at the start of a frequency file, the tokens follow it as records of
+//length (uint32_t), count (uint64_t) and the bytes of the token
+struct frequencyHeader{
+  //HCF_MAGIC
+  char magic[4];
+  //number of tokens
+  uint32_t count;
+};
+
+//a binary codebook mapped into memory
+struct binaryCodebook{
+  //the whole mapping and its size
+  void * map;
+  size_t mapSize;
+  //the header at the start of the mapping
+  struct binaryHeader * header;
+  //token i is pool[offsets[i]] up to pool[offsets[i+1]]
+  uint32_t * offsets;
+  //the canonical code of every token, right aligned
+  uint32_t * codes;
+  //the code length of every token
+  uint8_t * lengths;
+  //hash slots holding token index + 1, 0 marks an empty slot
+  uint32_t * index;
+  //the raw bytes of every token
+  char * pool;
+};
+
+//one slot of the open addressing hash table
+struct tableEntry{
+  //the key, NULL marks an empty slot
+  char * key;
+  //the length of the key
+  int keyLen;
+  //the full hash of the key so probing and growing never have to rehash or strcmp mismatches
+  uint32_t hash;
+  //frequency of the token when building, its code packed into the low bits when compressing
+  long value;
+  //the number of bits in the code when compressing
+  int bits;
+};
+
+//hash table with open addressing and linear probing that grows with its load factor
+struct hashMap{
+  //the slots, cap is always a power of two
+  struct tableEntry * slots;
+  int cap;
+  //the number of slots with a key in them
+  int used;
+};
+
+//walks through a buffer one SCAN_BLOCK at a time handing out the positions of spaces, tabs and newlines
+struct delimiterScanner{
+  //the buffer and its length
+  const char * buff;
+  int length;
+  //the start of the block the mask belongs to
+  int base;
+  //the delimiters of the block that have not been handed out yet
+  unsigned int mask;
+};
+
+//bump allocator that packs strings into big blocks so they don't need a malloc each, everything is freed at once
+struct arena{
+  //every block we have allocated so far
+  char ** blocks;
+  int numBlocks;
+  int blockCap;
+  //the free space left at the end of the newest block
+  char * next;
+  int left;
+  //the bytes of every block together
+  long size;
+};
+
+//one counter of a sketch
+struct sketchCounter{
+  //the token, a copy of its own that is freed when the counter is taken over
+  char * key;
+  int keyLen;
+  //the count and how much of it may belong to the tokens the counter took over
+  long count;
+  long error;
+  //where the counter sits in the heap
+  int heapPos;
+};
+
+//a space saving sketch: a fixed number of counters for the most frequent tokens, a new token takes over the smallest counter
+struct sketch{
+  //finds the counter of a token, the value of a slot is the index of its counter
+  struct hashMap table;
+  //the counters and a min heap of their indices ordered by count
+  struct sketchCounter * counters;
+  int * heap;
+  //used and allowed counters
+  int used;
+  int cap;
+};
+
+//the tokens counted so far and the arena their strings live in
+struct vocabulary{
+  struct hashMap table;
+  struct arena arena;
+  //with a memory budget (-m) the tokens are counted in this sketch instead of the table
+  struct sketch * sketch;
+  //with a spill budget (-s) the table is written to a sorted run on disk whenever it grows past this many bytes
+  long budget;
+};
+
+//a sorted run of token counts (a frequency file) being read back for the merge
+struct runReader{
+  //the mapped file and its size
+  char * map;
+  size_t size;
+  //the next record and the number of records after the current one
+  size_t pos;
+  uint32_t left;
+  //the current token and its count
+  char * key;
+  uint32_t keyLen;
+  uint64_t count;
+};
+
+//the files a group of build threads share, each thread takes the next file until none are left
+struct buildJob{
+  //the number of files and the next one to take
+  int filesSize;
+  int next;
+  pthread_mutex_t lock;
+};
+
+//a build thread counts into its own vocabulary so it never waits on the others
+struct buildWorker{
+  pthread_t thread;
+  struct buildJob * job;
+  struct vocabulary vocab;
+};
+
+//the files a pool of threads compresses or decompresses, the biggest files are handed out first
+struct fileJob{
+  //indices into files ordered from the biggest file to the smallest
+  int * order;
+  //the number of files and the next one to take
+  int filesSize;
+  int next;
+  pthread_mutex_t lock;
+  //compresses or decompresses one file with the thread's scratch space
+  int (*work)(int, unsigned char *);
+  //bytes of scratch space every thread needs for work
+  size_t scratchSize;
+  //set once work fails on any file
+  int failed;
+};
+
+//a file and its size, used to order the files of a job
+struct fileSize{
+  int index;
+  long size;
+};
+
+//what a codebook reader remembers between chunks of the codebook
+struct codebookState{
+  //whether the first line (the escape sequence) has been read
+  int started;
+  //whether the codebook only lists code lengths
+  int canonical;
+  //the tokens and lengths of a canonical codebook waiting for their codes
+  struct canonList pending;
+  //hands a token and its code over to the table or the decoder, both become its property
+  int (*insert)(char *, char *);
 };
 
 //prototypes
 int direcTraverse (DIR *, int, int, char *);
-int buildCodebook (int);
-int fileReader (int);
-int tableInsert (char *);
-int tokenizer (char *, int);
-int buildSubTrees();
-struct node * pop();
-int siftDown(struct node *, int);
-int heapTransfer();
-int increaseHeapSize();
-int siftUp(struct node *, int);
-int heapInsert(struct node *);
-void printHeap();
+int buildCodebook (int, int);
+void * buildThread(void *);
+int vocabMerge(struct vocabulary *, struct vocabulary *);
+int mergeFrequencies(char **, int, char *, int, long);
+int readFrequencies(char *);
+int writeFrequencies(char *);
+int writeRun(int, struct vocabulary *);
+int keyOrder(const char *, int, const char *, int);
+int runCompare(const void *, const void *);
+int spillRun(struct vocabulary *);
+int tempRun(char **);
+int runOpen(struct runReader *, char *);
+int runNext(struct runReader *);
+void runSift(struct runReader *, int *, int, int);
+int mergeRuns(char **, int, char *, int, long);
+void writeBuild(int, int, int, int, long);
+int leafCompare(const void *, const void *);
+struct leaf * sortLeaves(int *);
+int keepLeaves(struct leaf *, int *, int, long);
+int huffmanLengths(int, long);
+int fileReader (int, struct vocabulary *);
+int streamFile(int, int (*)(char *, int, int, void *), void *);
+int mapFile(int, int (*)(char *, int, int, void *), void *);
+int lastDelimiter(char *, int, char *);
+void pickDelimiterScan();
+void scannerInit(struct delimiterScanner *, const char *, int);
+int scannerNext(struct delimiterScanner *);
+unsigned int scalarDelimiters(const char *);
+#ifdef __SSE2__
+unsigned int sse2Delimiters(const char *);
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2"))) unsigned int avx2Delimiters(const char *);
+#endif
+int tokenizeChunk(char *, int, int, void *);
+int compressChunk(char *, int, int, void *);
+int codebookChunk(char *, int, int, void *);
+int finishCodebook(struct codebookState *);
+int decoderInsert(char *, char *);
+int tableInsert (struct vocabulary *, char *, int);
+char * arenaString(struct arena *, const char *, int);
+void arenaFree(struct arena *);
+void freeDecoder();
+int mapInit(struct hashMap *, int);
+struct tableEntry * mapFind(struct hashMap *, const char *, int, uint32_t);
+struct tableEntry * mapInsert(struct hashMap *, char *, int, int *);
+int mapGrow(struct hashMap *);
+void mapFree(struct hashMap *);
+void mapRemove(struct hashMap *, struct tableEntry *);
+int sketchInit(struct vocabulary *, long);
+int sketchAdd(struct sketch *, const char *, int, long, long);
+void sketchSift(struct sketch *, int);
+int sketchUnload(struct vocabulary *);
+void sketchFree(struct sketch *);
+int tokenizer (char *, int, struct vocabulary *);
 int printTable();
 void freeFiles(int);
-int decompressFiles(int);
-void buildHuffTree(char *, int);
+int decompressFiles(int, int);
+int decompressFile(int, unsigned char *);
+int runFileJob(int, int, int (*)(int, unsigned char *), size_t);
+void * fileThread(void *);
+int sizeCompare(const void *, const void *);
 int codebookReader (int);
-int huffInsert(char *, char *, struct node *);
-int readHcz(int, int);
+int decoderAddCode(unsigned long long, int, char *, int);
+int buildDecodeTables();
+int buildDecodeLevel(int, int, int, int *);
+int codeCompare(const void *, const void *);
+int codeBits(unsigned long long, int, int, int);
+int bitReaderFill(struct bitReader *);
+int bitReaderBytes(struct bitReader *, unsigned char *, int);
+int decodeBits(struct bitReader *, struct byteWriter *);
+int bitReaderTake(struct bitReader *, int, unsigned int *);
+int decodeLiteral(struct bitReader *, struct byteWriter *);
+int byteWriterPut(struct byteWriter *, char *, int);
+int byteWriterFlush(struct byteWriter *);
+int byteWriterWrite(struct byteWriter *, char *, long);
+int readIndexedHcz(int, int, long);
+void * decodeThread(void *);
+int readHcz(int, int, unsigned char *, char *);
 int huffmanCodebookReader (int);
-int huffTokenizer (char *, int);
+int huffTokenizer (char *, int, struct codebookState *);
 int hInsert (char *, char *);
-int compressionFileReader (int, int);
-int compressionWriter(char *, int);
-int savTokenizer (char *, int, int);
-int compressFiles(int);
+int compressionFileReader (int, int, unsigned char *);
+int compressBlocks(int, int, unsigned char *);
+int encodeBlock(struct hczBlock *, unsigned char *);
+void * blockThread(void *);
+void storeLE64(unsigned char *, unsigned long long);
+unsigned long long loadLE64(const unsigned char *);
+long parseSize(const char *);
+int compressionWriter(char *, int, struct bitWriter *);
+int literalWriter(char *, int, struct bitWriter *);
+int savTokenizer (char *, int, struct bitWriter *);
+void bitWriterOpen(struct bitWriter *, int, unsigned char *);
+int bitWriterInit(struct bitWriter *, int, unsigned char *);
+int bitWriterPutBits(struct bitWriter *, unsigned long long, int);
+int bitWriterFlush(struct bitWriter *);
+int bitWriterFinish(struct bitWriter *);
+int compressFiles(int, int);
+int compressFile(int, unsigned char *);
 int freeHuffmanTable();
-int depthFirstSearch(struct node *, int, char *);
-
-//heap represented as an array with its capacity
-struct heap{
-  //heap array
-  struct node **arr;
-  //current used capacity
-  int used;
-  //current capacity of the heap
-  int cap;
-};
-
-//struct for the comparision nodes hashtable
-struct huffNode { // the huffman codebook nodes
-  char * token; // the token
-  char * bittok; // the bitcode
-  struct huffNode * next; // the next node in the linked list (these nodes will be stored in a hashtable)
-};
+int canonAdd(struct canonList *, char *, int, long);
+int limitCodeLengths(int);
+int weightCompare(const void *, const void *);
+unsigned int * canonCodes(struct canonList *);
+char * codeString(struct arena *, unsigned int, int);
+int canonCompare(const void *, const void *);
+int writeCodebook(int, int, int);
+int writeBinaryCodebook(int, struct canonList *, unsigned int *);
+uint32_t hashToken(const char *, int);
+struct binaryCodebook * openBinaryCodebook(int);
+int binaryLookup(struct binaryCodebook *, const char *, int);
+int binaryDecoder(struct binaryCodebook *);
 
 //global variables
 char ** files;
-struct node * hashTable[256];
-struct huffNode * huffmanTable[256];
-struct heap * myHeap;
-struct node * huffHead;
+struct vocabulary vocab;
+struct hashMap huffmanTable;
+struct decoder * myDecoder;
+struct canonList * codeList;
+struct binaryCodebook * binBook;
+//owns every token and code read from the codebook, for compressing and decompressing alike
+struct arena codebookArena;
 char * escapeSequence;
+//the size of the blocks -B splits files into (0 compresses files as one stream) and the threads coding them
+long blockSize;
+int blockThreads;
+//the memory the build may count tokens in (-m), 0 counts every token exactly
+long sketchBudget;
+//the memory the exact counts may take before they are spilled to disk (-s), 0 keeps them all in memory
+long spillBudget;
+//the runs spilled so far, the build threads share them
+char ** spillRuns;
+int numSpillRuns;
+int spillRunCap;
+pthread_mutex_t spillLock = PTHREAD_MUTEX_INITIALIZER;
+//the leaves a spilled build read out of its merged run, and the mapped file holding their tokens
+struct leaf * runLeaves;
+int numRunLeaves;
+char * runTokens;
+size_t runTokensSize;
+//the widest delimiter scan this machine supports, picked when we start
+unsigned int (*delimiterMask)(const char *);
 
 /* The brains of the operation */
 int main (int argc, char ** argv){
@@ -93,14 +552,33 @@ int main (int argc, char ** argv){
   int build = 0;
   //the -R flag was passed
   int recursive = 0;
+  //the -C flag was passed, the codebook only stores code lengths
+  int canonical = 0;
+  //the -x flag was passed, the codebook is written in the binary format
+  int binary = 0;
+  //the number of threads to work with, -j changes it
+  int threads = 1;
+  //the longest code the build may hand out, -L changes it
+  int maxCodeLength = MAX_CODE_LENGTH;
+  //the most tokens (-k) and the least frequency (-f) a token needs to get a code of its own, 0 keeps them all
+  int topK = 0;
+  long minFreq = 0;
   //the -c flag was passed
   int compress = 0;
   //the -d flag was passed
   int decompress = 0;
+  //frequency files to add to the counts (-u) and the file to save the counts in (-F)
+  char ** freqInputs = (char **)malloc(argc*sizeof(char *));
+  int numFreqInputs = 0;
+  char * freqOutput = NULL;
+  //whether a codebook was built from files
+  int built = 0;
   //counter for the loop
   int i = 0;
   //stores the number of files given
-  int fileCounter;
+  int fileCounter = 0;
+  //the tokenizers share one delimiter scan
+  pickDelimiterScan();
   //loop through the arguments
   for(i = 0; i < argc; i++){
     //check the flags / set the flags
@@ -110,6 +588,73 @@ int main (int argc, char ** argv){
     } else if(strcmp(argv[i], "-R") == 0){
       //set the recursive flag to be true
       recursive = 1;
+    } else if(strcmp(argv[i], "-L") == 0 && i+1 < argc){
+      //limit the length of the codes
+      maxCodeLength = atoi(argv[++i]);
+      //the codes have to fit in a machine word
+      if(maxCodeLength < 1 || maxCodeLength > MAX_CODE_LENGTH){
+        printf("ERROR: -L takes a code length between 1 and %d\n", MAX_CODE_LENGTH);
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-k") == 0 && i+1 < argc){
+      //only keep the most frequent tokens
+      topK = atoi(argv[++i]);
+      //we need at least one token
+      if(topK < 1){
+        printf("ERROR: -k takes a number of tokens of at least 1\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-f") == 0 && i+1 < argc){
+      //only keep tokens we have seen often enough
+      minFreq = atol(argv[++i]);
+      //every token was seen at least once
+      if(minFreq < 1){
+        printf("ERROR: -f takes a frequency of at least 1\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-m") == 0 && i+1 < argc){
+      //count the tokens approximately in about this much memory
+      sketchBudget = parseSize(argv[++i]);
+      //the budget needs to hold at least one counter
+      if(sketchBudget < 1){
+        printf("ERROR: -m takes a memory budget like 256M, 64K or 1048576\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-s") == 0 && i+1 < argc){
+      //count exactly, but spill the counts to disk whenever they take more than this much memory
+      spillBudget = parseSize(argv[++i]);
+      if(spillBudget < 1){
+        printf("ERROR: -s takes a memory budget like 256M, 64K or 1048576\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-F") == 0 && i+1 < argc){
+      //save the counts so later builds can start from them
+      freqOutput = argv[++i];
+    } else if(strcmp(argv[i], "-u") == 0 && i+1 < argc && freqInputs){
+      //add the counts of an earlier build
+      freqInputs[numFreqInputs++] = argv[++i];
+    } else if(strcmp(argv[i], "-j") == 0 && i+1 < argc){
+      //work on several files at once
+      threads = atoi(argv[++i]);
+      //we need at least one thread
+      if(threads < 1){
+        printf("ERROR: -j takes a number of threads of at least 1\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-B") == 0 && i+1 < argc){
+      //split files into blocks of about this size that are compressed in parallel
+      blockSize = parseSize(argv[++i]);
+      //blocks need to have something in them
+      if(blockSize < 1 || blockSize > INT_MAX){
+        printf("ERROR: -B takes a block size like 4M, 512K or 65536\n");
+        exit(0);
+      }
+    } else if(strcmp(argv[i], "-x") == 0){
+      //write a binary codebook
+      binary = 1;
+    } else if(strcmp(argv[i], "-C") == 0){
+      //write a length only canonical codebook
+      canonical = 1;
     } else if(strcmp(argv[i], "-c") == 0){
       //we need to compress the given file
       compress = 1;
@@ -124,8 +669,13 @@ int main (int argc, char ** argv){
         //exit this mofo
         exit(0);
       }
-      //we're building a hash table, memset that mofo
-      memset(hashTable, 0x0, 256*sizeof(struct node *));
+      //we're building a hash table, start it off empty
+      if(mapInit(&vocab.table, 1024)){
+        //no space
+        printf("FATAL ERROR: Not enough memory\n");
+        //exit the code
+        exit(0);
+      }
       //check if we have to traverse multiple files
       if(recursive){
         //make space in the files array
@@ -165,66 +715,16 @@ int main (int argc, char ** argv){
         //assign 1 to the file counter variable
         fileCounter = 1;
       }
-      //we need to build the huffman codebook
-      if(buildCodebook(fileCounter)){
+      //we need to build the huffman codebook from the files and any saved counts, it always gets an escape code so tokens it has never seen can still be compressed
+      if(buildCodebook(fileCounter, threads) || mergeFrequencies(freqInputs, numFreqInputs, freqOutput, topK, minFreq) || tableInsert(&vocab, "$e", 2)){
         //1 is unsuccessful, and zero is successfull
         printf("FATAL ERROR: Unable to build codebook\n");
         //exit
         exit(0);
       }
-      //after building the hashtable, we need to store everything in a heap
-      myHeap = (struct heap *)malloc(sizeof(struct heap));
-      //check for memory capacity
-      if(!myHeap){
-        //file does not exist it is a fatal error
-        printf("FATAL ERROR: Not enough memory\n");
-        //exit the code
-        exit(0);
-      }
-      //start with an initial capacity of 101
-      myHeap -> arr = (struct node **)malloc(101*sizeof(struct node *));
-      //check for memory capacity
-      if(!(myHeap->arr)){
-        //file does not exist it is a fatal error
-        printf("FATAL ERROR: Not enough memory\n");
-        //exit the code
-        exit(0);
-      }
-      //the array initially has 100 spaces with 1 space hidden
-      myHeap -> cap = 100;
-      //set all the elements to null just in case
-      memset(myHeap -> arr, 0x0, (myHeap -> cap)*sizeof(struct node *));
-      //the heap is initially empty
-      myHeap -> used = 0;
-      //we need to transfer the hashtable into the heap
-      if(heapTransfer()){
-        //transfering hashtable into the minheap was unsuccessfull
-        printf("FATAL ERROR: Transfering hashtable into the minheap was unsuccessfull\n");
-        //exit
-        exit(0);
-      }
-      //now we need to start building the Huffman Tree
-      if(buildSubTrees()){
-        //build subtrees was unsuccessful
-        printf("FATAL ERROR: Building subtrees was unsuccessful\n");
-        //exit
-        exit(0);
-      }
-      //once the subtrees are built, we need to write to a huffman codebook, FIRST CREATE a codebook file
-      int codFD = open("HuffmanCodebook", O_TRUNC | O_RDWR | O_CREAT,  S_IRUSR | S_IWUSR);
-      //creating the file is unsuccessfull
-      if(codFD < 0){
-        //unable to open the codebook for whatever reason
-        printf("FATAL ERROR: Unable to open the huffman codebook file\n");
-      }
-      //assign the value of the escape sequence
-      escapeSequence = "$\0";
-      //write the escape character being used
-      write(codFD, "$\n", 2);
-      //call the DFS to calculate the huffman codes
-      depthFirstSearch(huffHead, codFD, "");
-      //close the file descriptor once we're done writing
-      close(codFD);
+      //write the codebook
+      writeBuild(canonical, binary, maxCodeLength, topK, minFreq);
+      built = 1;
     } else if(decompress){
       //first makesure that you have a codebook argument
       if(i == argc-1){
@@ -279,17 +779,18 @@ int main (int argc, char ** argv){
         //codebook not present
         printf("WARNING: Codebook not present\n");
       }
-      //allocate the parent node for the huffman tree TODO: free this tree
-      huffHead = (struct node *)malloc(sizeof(struct node));
+      //allocate the decoder that holds the decode tables
+      myDecoder = (struct decoder *)malloc(sizeof(struct decoder));
       //check for memory
-      if(!huffHead){
-        //codebook not present
+      if(!myDecoder){
+        //no space
         printf("FATAL ERROR: Not enough memory\n");
+        //exit the code
+        exit(0);
       }
-      //recreating the huffman tree, make both children null
-      huffHead -> rChild = NULL;
-      huffHead -> lChild = NULL;
-      //we need to build the huffman tree
+      //the decoder starts out empty
+      memset(myDecoder, 0x0, sizeof(struct decoder));
+      //we need to read the codebook and build the decode tables
       if(codebookReader(cdFd)){
         //we were unable to read the codebook
         printf("FATAL ERROR: Unable to read the huffman codebook\n");
@@ -297,14 +798,16 @@ int main (int argc, char ** argv){
         exit(0);
       }
       //decompress files reads our file(s) and converts back into regular text
-      if(decompressFiles(fileCounter)){
+      if(decompressFiles(fileCounter, threads)){
         //we were unable to read the codebook
         printf("FATAL ERROR: Unable to read the decompress files\n");
         //exit
-        exit(0);
+        exit(1);
       }
       //close the file descriptor used to read the codebook
       close(cdFd);
+      //free the decoder
+      freeDecoder();
     } else if(compress){
       //first makesure that you have a codebook argument
       if(i == argc-1){
@@ -368,11 +871,11 @@ int main (int argc, char ** argv){
         exit(0);
       }
       //compress the files in our files array
-      if(compressFiles(fileCounter)){
+      if(compressFiles(fileCounter, threads)){
         //print an error
         printf("ERROR: Unable to compress given file(s)\n");
         //exit the code
-        exit(0);
+        exit(1);
       }
       //close the huffman codebook file descriptor
       close(huffFD);
@@ -380,6 +883,15 @@ int main (int argc, char ** argv){
       freeHuffmanTable();
     }
   }
+  //without any files to count, the codebook is built from the saved counts alone
+  if(build && !built && numFreqInputs > 0){
+    if(mapInit(&vocab.table, 1024) || mergeFrequencies(freqInputs, numFreqInputs, freqOutput, topK, minFreq) || tableInsert(&vocab, "$e", 2)){
+      printf("FATAL ERROR: Unable to build codebook\n");
+      exit(0);
+    }
+    writeBuild(canonical, binary, maxCodeLength, topK, minFreq);
+  }
+  free(freqInputs);
   //release the files!
   freeFiles(fileCounter);
   clock_t toc = clock();
@@ -390,36 +902,63 @@ int main (int argc, char ** argv){
 
 /*Frees the Huffman Table*/
 int freeHuffmanTable(){
-  //traversal nodes 
-  struct huffNode * head;
-  struct huffNode * temp;
-  //looping index
-  int i;
-  //loop through the whole table
-  for(i = 0; i < 256; i++){
-    //assign the node at i to head
-    head = huffmanTable[i];
-    //loop through the table
-    while(head != NULL){
-      //assign temp to be the next
-      temp = head -> next;
-      //free the contents
-      free(head->token);
-      free(head->bittok);
-      //free the head
-      free(head);
-      //reassign head to temp
-      head = temp;
-    }
+  //a binary codebook only has to be unmapped
+  if(binBook){
+    munmap(binBook -> map, binBook -> mapSize);
+    free(binBook);
+    binBook = NULL;
   }
+  //free the slots themselves
+  mapFree(&huffmanTable);
+  //every token and code goes in one shot
+  arenaFree(&codebookArena);
   //return success
   return 0;
 }
 
-/* this method traverses the files array and compresses all of them returns 0 on success*/
-int compressFiles(int numOfFiles){
-  //loop counter
-  int i;
+/* frees the decode tables, the symbols and everything read from the codebook */
+void freeDecoder(){
+  //the symbols of a binary codebook point into its mapping
+  if(binBook){
+    munmap(binBook -> map, binBook -> mapSize);
+    free(binBook);
+    binBook = NULL;
+  }
+  //free the tables and symbol arrays
+  free(myDecoder -> table);
+  free(myDecoder -> symbols);
+  free(myDecoder -> symbolLens);
+  free(myDecoder -> codes);
+  free(myDecoder -> codeLens);
+  free(myDecoder);
+  myDecoder = NULL;
+  //every token and code goes in one shot
+  arenaFree(&codebookArena);
+}
+
+/* this method traverses the files array and compresses all of them on the given number of threads, returns 0 on success*/
+int compressFiles(int numOfFiles, int threads){
+  //stores the length of the only file
+  int length;
+  //a lone .hcz file can't be compressed again
+  if(numOfFiles == 1){
+    length = strlen(files[0]);
+    if(length > 4 && strcmp(&files[0][length-4], ".hcz") == 0){
+      //returning 1 will triger a print in the main method
+      return 1;
+    }
+  }
+  //in block mode the threads work on the blocks of one file at a time instead
+  if(blockSize > 0){
+    blockThreads = threads;
+    threads = 1;
+  }
+  //compress every file
+  return runFileJob(numOfFiles, threads, compressFile, IO_BUFFER_SIZE);
+}
+
+/* compresses the file at the given index with the thread's output buffer, .hcz files are skipped */
+int compressFile(int i, unsigned char * outBuff){
   //stores the file extension of the current file (used to skip .hcz files)
   char fileType[5];
   //stores the file path of the .hcz file
@@ -430,1453 +969,4065 @@ int compressFiles(int numOfFiles){
   int fd;
   //file descriptor opens the current .hcz file
   int writefd;
-  //loop through the files and skip the ones not compressed already
-  for(i = 0; i < numOfFiles; i++){
-    //calculate the index of the point
-    length = strlen(files[i]);
-    //first check if the string is less than 5 characters long
-    if(length > 4){
-      //extract the file extension from the path
-      strncpy(fileType, &files[i][length-4], 4);
-      //null terminate the filetype
-      fileType[4] = '\0';
-      //check if the file is an hcz file and skip if it is
-      if(strcmp(fileType, ".hcz") == 0){
-        //if this is the only file, we want to return an error
-        if(numOfFiles == 1){
-          //returning 1 will triger a print in the main method
-          return 1;
-        }
-        //skip this file
-        continue;
-      }
-    }
-    //open the uncompressed file
-    fd = open(files[i], O_RDONLY);
-    //check to see if there was trouble opening the file
-    if(fd < 0){
-      //print error
-      printf("ERROR: Unable to open the %dth uncompressed file\n", i);
-      //exit in style
-      exit(0);
-    }
-    //copy the files[i] into the newfilepath
-    strcpy(newFilePath, files[i]);
-    //concatenate the .hcz onto the new file path
-    strcat(newFilePath, ".hcz\0");
-    //also open the file descriptor to write
-    writefd = open(newFilePath, O_TRUNC | O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-    //check to see if there was trouble opening the file
-    if(writefd < 0){
-      //print error
-      printf("ERROR: Unable to open the .hcz for the %dth uncompressed file\n", i);
-      //exit in style
-      exit(0);
-    }
-    //read the file
-    if(compressionFileReader(fd, writefd)){
-      //error while trying to compress a file
-      printf("ERROR: Unable to compress file %d\n", i);
+  //the bits are written to a temp file next to the .hcz, so a failed file leaves nothing half written behind
+  char tempPath[PATH_MAX+8];
+  //whether compressing failed
+  int failed;
+  //calculate the index of the point
+  length = strlen(files[i]);
+  //first check if the string is less than 5 characters long
+  if(length > 4){
+    //extract the file extension from the path
+    strncpy(fileType, &files[i][length-4], 4);
+    //null terminate the filetype
+    fileType[4] = '\0';
+    //check if the file is an hcz file and skip if it is
+    if(strcmp(fileType, ".hcz") == 0){
+      return 0;
     }
-    //close both file descriptors once we are done using them
+  }
+  //open the uncompressed file
+  fd = open(files[i], O_RDONLY);
+  //check to see if there was trouble opening the file
+  if(fd < 0){
+    //print error
+    printf("ERROR: Unable to open the %dth uncompressed file\n", i);
+    return 1;
+  }
+  //copy the files[i] into the newfilepath
+  strcpy(newFilePath, files[i]);
+  //concatenate the .hcz onto the new file path
+  strcat(newFilePath, ".hcz\0");
+  //also open the temp file to write
+  sprintf(tempPath, "%s.XXXXXX", newFilePath);
+  writefd = mkstemp(tempPath);
+  //check to see if there was trouble opening the file
+  if(writefd < 0){
+    //print error
+    printf("ERROR: Unable to open the .hcz for the %dth uncompressed file\n", i);
     close(fd);
-    close(writefd);
+    return 1;
+  }
+  //read the file, in blocks if we were asked to
+  failed = blockSize > 0 ? compressBlocks(fd, writefd, outBuff) : compressionFileReader(fd, writefd, outBuff);
+  //close both file descriptors once we are done using them
+  close(fd);
+  close(writefd);
+  //the .hcz only shows up once it is complete
+  if(failed || rename(tempPath, newFilePath) < 0){
+    //error while trying to compress a file
+    printf("ERROR: Unable to compress file %d\n", i);
+    unlink(tempPath);
+    return 1;
   }
   //we were successfull
   return 0;
 }
 
-/* Reads the given file and loads it into a local buffer calls sav tokenizer afterwards*/
-int compressionFileReader (int fileDescriptor, int writeFD){
-  //buffer size
-  int buffSize = 100;
-  //create the buffer to store the file
-  char *myBuffer = (char *)malloc(101*sizeof(char));
-  //check if the pointer is null
-  if(myBuffer == NULL){
-    //print an error
-    printf("ERROR: Not enough space on heap\n");
+/* hands every file to work on a pool of threads sharing the read only codebook, biggest files first
+so the job doesn't end waiting on one big file, every thread gets scratchSize bytes for work, returns 0 on success */
+int runFileJob(int numOfFiles, int threads, int (*work)(int, unsigned char *), size_t scratchSize){
+  //loop counter
+  int i;
+  //the files and their sizes
+  struct fileSize * sizes;
+  //the size of a file
+  struct stat fileStat;
+  //the job the threads share
+  struct fileJob job;
+  //the threads
+  pthread_t * pool;
+  //make space for the order
+  job.order = (int *)malloc((numOfFiles+1)*sizeof(int));
+  sizes = (struct fileSize *)malloc((numOfFiles+1)*sizeof(struct fileSize));
+  if(!job.order || !sizes){
+    //no space
+    printf("FATAL ERROR: Not enough memory\n");
+    return 1;
   }
-  //set everything in the buffer to the null terminator
-  memset(myBuffer, '\0', 101);
-  //store the status of the read
-  int readIn = 0;
-  int status = 1;
-  //temp pointer to hold the dynamically sized buffer
-  char *temp;
-  //loop until everything has been read
-  while(status > 0){ 
-    //read buff size number of chars and store in myBuffer
-    do{
-      status = read(fileDescriptor, myBuffer+readIn, 100);
-      readIn += status;
-    }while(readIn < buffSize && status > 0);
-    //check if there are more chars left
-    if(status > 0){
-      //increase the array size by 100
-      buffSize += 100;
-      //store the old values in the temp pointer
-      temp = myBuffer;
-      //malloc the new array to myBuffer
-      myBuffer = (char *)malloc(buffSize*sizeof(char));
-      //check if the pointer is null
-      if(myBuffer == NULL){
-        //print an error
-        printf("ERROR: Not enough space on heap\n");
-        //exit
-        return 1;
+  //find the size of every file, ones we can't stat go last and report their errors when they're opened
+  for(i = 0; i < numOfFiles; i++){
+    sizes[i].index = i;
+    sizes[i].size = stat(files[i], &fileStat) == 0 ? fileStat.st_size : -1;
+  }
+  //biggest first
+  qsort(sizes, numOfFiles, sizeof(struct fileSize), sizeCompare);
+  for(i = 0; i < numOfFiles; i++){
+    job.order[i] = sizes[i].index;
+  }
+  free(sizes);
+  //every thread starts at the first file
+  job.filesSize = numOfFiles;
+  job.next = 0;
+  job.work = work;
+  job.scratchSize = scratchSize;
+  job.failed = 0;
+  pthread_mutex_init(&job.lock, NULL);
+  //there's no point in more threads than files
+  if(threads > numOfFiles){
+    threads = numOfFiles;
+  }
+  //a single thread does the work itself
+  if(threads <= 1){
+    fileThread(&job);
+  } else{
+    pool = (pthread_t *)malloc(threads*sizeof(pthread_t));
+    if(!pool){
+      printf("FATAL ERROR: Not enough memory\n");
+      return 1;
+    }
+    //start the threads
+    for(i = 0; i < threads; i++){
+      if(pthread_create(&pool[i], NULL, fileThread, &job)){
+        printf("FATAL ERROR: Unable to start a worker thread\n");
+        exit(1);
       }
-      //set everything in the buffer to the null terminator
-      memset(myBuffer, '\0', buffSize);
-      //copy the old memory into the new buffer
-      memcpy(myBuffer, temp, readIn);
-      //free the old memory that was allocated temporarily
-      free(temp);
     }
+    //wait for all of them to run out of files
+    for(i = 0; i < threads; i++){
+      pthread_join(pool[i], NULL);
+    }
+    free(pool);
   }
-  //we hand over the contents of our file (stored in buffer) to the table loader function
-  if(savTokenizer(myBuffer, buffSize, writeFD)){
-    //print the error
-    printf("ERROR: While trying to tokenize the file\n");
-    //there was an error in the tokenizer
-    return 1;
-  }
-  //finish it
-  return 0;
+  //clean up
+  pthread_mutex_destroy(&job.lock);
+  free(job.order);
+  //nonzero if any file failed
+  return job.failed;
 }
 
-/* After reading the complete contents of a given file(in this case the text file we want compressed), we need to split the file up into tokens
-and then load each token into the linked list.  This is also a modified version of Adviths tokenizer */
-int savTokenizer (char *buff, int buffSize, int writeFD){
-  //counter to loop through the buffer
-  int counter = 0;
-  //counter to loop through the cdata
-  int localcount = 0;
-  //store the current character
-  char ctemp;
-  //allocate starting space into cdata
-  char *cdata = (char *)malloc(11*sizeof(char));
-  //temp when you need to expand the string tokens
-  char *temp;
-  //check if the pointer is null
-  if(cdata == NULL){
-    //print an error
-    printf("ERROR: Not enough space on heap\n");
-    //return unsuccessfull
-    return 1;
+/* a worker keeps taking the next file of the job until there are none left, with scratch space of its own */
+void * fileThread(void * arg){
+  //the job we're working on
+  struct fileJob * job = (struct fileJob *)arg;
+  //the next file to work on
+  int index;
+  //the scratch space is reused for every file
+  unsigned char * scratch = (unsigned char *)malloc(job -> scratchSize);
+  //check for memory
+  if(!scratch){
+    //no space
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(1);
   }
-  //set the array to be all null terminators
-  memset(cdata, '\0', 11);
-  //current size of cdata
-  int currSize = 10;
-  //loop through the string until we hit a comma or terminator
-  while(buff[counter] != '\0'){
-    //get the current character at every iteration
-    ctemp = buff[counter];
-    //check if we have hit a control character
-    if(ctemp == '\t' || ctemp == ' ' || ctemp == '\n'){
-      //we don't need to store empty tokens
-      if(strcmp(cdata, "") != 0){
-        //isolate the token and insert it into the table
-        compressionWriter(cdata, writeFD);
-        //freecdata we're done with using it
-        free(cdata);
-        //allocate a new cdata for the next token
-        cdata = (char *)malloc(11*sizeof(char));
-        //set the array to be all null terminators
-        memset(cdata, '\0', 11);
-        //reset the curr size
-        currSize = 10;
-      }
-      //reset the local count
-      localcount = -1;
-      //also insert the special terminator character
-      switch(ctemp){
-        case '\t':
-          compressionWriter("\t", writeFD);
-          break;
-        case ' ':
-          compressionWriter(" ", writeFD);
-          break;
-        case '\n':
-          compressionWriter("\n", writeFD);
-          break;
-      }
-    } else if(localcount >= currSize){ //store the character in the node array but first check for overflow
-      //make the cdata array 10 characters bigger
-      currSize += 10;
-      //store the old values in the temp pointer
-      temp = cdata;
-      //malloc the new array to myBuffer
-      cdata = (char *)malloc(currSize*sizeof(char));
-      //check if the pointer is null
-      if(cdata == NULL){
-        //print an error
-        printf("ERROR: Not enough space on heap\n");
-        //return an error
-        return 1;
-      }
-      //set the random stuff to null terminators again
-      memset(cdata, '\0', currSize);
-      //copy the old memory into the new buffer
-      memcpy(cdata, temp, localcount);
-      //free the old variable
-      free(temp);
-      //store the buffer char
-      cdata[localcount] = buff[counter];
-    } else{
-      //store the buffer character into the cdata character
-      cdata[localcount] = buff[counter];
+  while(1){
+    //take the next file
+    pthread_mutex_lock(&job -> lock);
+    index = job -> next++;
+    pthread_mutex_unlock(&job -> lock);
+    //check if we're done
+    if(index >= job -> filesSize){
+      break;
+    }
+    if(job -> work(job -> order[index], scratch)){
+      //remember the failure, the other files still get their turn
+      pthread_mutex_lock(&job -> lock);
+      job -> failed = 1;
+      pthread_mutex_unlock(&job -> lock);
     }
-    //increment counters
-    counter++;
-    localcount++;
-  }
-  //we have reached the end put the last guy in there
-  if(buff[counter] == '\0'){
-    //isolate the token and insert it into the table
-    compressionWriter(cdata, writeFD);
   }
-  //free the original character buffer before leaving
-  free(buff);
-  //return success!
-  return 0;
+  //release the scratch space
+  free(scratch);
+  return NULL;
 }
 
-/*given the token and the file descriptor, this method writes the token's bitcode to the file descriptor*/
-int compressionWriter(char * token, int fd){
-  //store the current node
-  struct huffNode * curr;
-  //calculate the hash code
-  int sum = 0;
-  //index
-  int k;
-  //loop through the characters of the token
-  for (k = 0; k < strlen(token); k++){
-    //calculate the ascii sum of the token
-    sum = sum + (int)token[k];
-  }
-  //mod it to fit inside the 256 length array
-  int index = sum % 256;
-  //error check the index
-  if(index < 0){
-    //make the index positive
-    index *= -1;
-  }
-  //check to see if the head node of the given index is Null
-  if(huffmanTable[index] == NULL){
-    //there is an error
-    printf("ERROR: Codebook mismatch, your codebook might be empty\n");
-    //exit this badboy
-    exit(0);
-  } else{
-    //gather the current node
-    curr = huffmanTable[index];
-    //we need to traverse and find the bitcode
-    while(curr != NULL){
-      //check if the current node is our desired token
-      if(strcmp(curr->token, token) == 0){
-        //we need to write our bitcode
-        write(fd, curr->bittok, strlen(curr->bittok));
-        //break the loop once we are done
-        break;
-      }
-      //make sure to traverse through the whole damn list
-      curr = curr -> next;
-    }
+/*orders files from the biggest to the smallest, keeping the listing order between files of the same size*/
+int sizeCompare(const void * a, const void * b){
+  const struct fileSize * x = (const struct fileSize *)a;
+  const struct fileSize * y = (const struct fileSize *)b;
+  if(x -> size != y -> size){
+    return x -> size > y -> size ? -1 : 1;
   }
-  //success!
-  return 0;
+  return x -> index - y -> index;
 }
 
-/* Read the given file descriptor and write each item to the huffman table */
-int huffmanCodebookReader (int fileDescriptor){
-  //buffer size
-  int buffSize = 100;
-  //create the buffer to store the file
-  char *myBuffer = (char *)malloc(101*sizeof(char));
-  //check if the pointer is null
-  if(!myBuffer){
-    //print an error
-    printf("ERROR: Not enough space on heap\n");
+/* Reads the given file and loads it into a local buffer calls sav tokenizer afterwards*/
+int compressionFileReader (int fileDescriptor, int writeFD, unsigned char * outBuff){
+  //the bit writer packs our codes into the .hcz file
+  struct bitWriter writer;
+  //write the .hcz header before any of the codes
+  if(bitWriterInit(&writer, writeFD, outBuff)){
+    //print the error
+    printf("ERROR: Unable to write the .hcz header\n");
     //we were unsuccessful
     return 1;
   }
-  //set everything in the buffer to the null terminator
-  memset(myBuffer, '\0', 101);
-  //store the status of the read
-  int readIn = 0;
-  int status = 1;
-  //temp pointer to hold the dynamically sized buffer
-  char *temp;
-  //loop until everything has been read
-  while(status > 0){ 
-    //read buff size number of chars and store in myBuffer
-    do{
-      status = read(fileDescriptor, myBuffer+readIn, 100);
-      readIn += status;
-    }while(readIn < buffSize && status > 0);
-    //check if there are more chars left
-    if(status > 0){
-      //increase the array size by 100
-      buffSize += 100;
-      //store the old values in the temp pointer
-      temp = myBuffer;
-      //malloc the new array to myBuffer
-      myBuffer = (char *)malloc(buffSize*sizeof(char));
-      //check if the pointer is null
-      if(myBuffer == NULL){
-        //print an error
-        printf("ERROR: Not enough space on heap\n");
-        //we were unnseccufl
-        return 1;
-      }
-      //copy the old memory into the new buffer
-      memcpy(myBuffer, temp, readIn);
-      //free the old memory that was allocated
-      free(temp);
-    }
+  //stream the file through the tokenizer one chunk at a time
+  if(mapFile(fileDescriptor, compressChunk, &writer)){
+    //print the error
+    printf("ERROR: While trying to tokenize the file\n");
+    //there was an error in the tokenizer
+    return 1;
   }
-  //we need to split the buffer into tokens
-  if(huffTokenizer(myBuffer, readIn)){
-    //there was an error
-    printf("ERROR: Unable to tokenize given codebook\n");
-    //return unsuccessful
+  //write out the last partial byte and record how many of its bits are valid
+  if(bitWriterFinish(&writer)){
+    //print the error
+    printf("ERROR: Unable to finish writing the .hcz file\n");
+    //we were unsuccessful
     return 1;
   }
-  //free the buffer once it has been broken into tokens
-  free(myBuffer);
-  //success!
+  //finish it
   return 0;
 }
 
-/*this method will be for going through the huffman codebook*/
-int huffTokenizer (char *buff, int buffSize){
-  //check to see that we have shit in the buffer
-  if(buffSize == 0){
-    //print an error
-    printf("WARNING: Empty codebook\n");
-    //return unsuccessfull
+/* maps the file, splits it at whitespace into blocks of about blockSize bytes and codes them on blockThreads threads.
+The blocks are written in order after a version 2 header, each one framed by its bit length, and an end frame closes them.
+An index of the blocks (frame offset, bit length and text size) and a footer follow so they can be decoded in parallel.
+Files that can't be mapped are compressed as a single stream */
+int compressBlocks(int fileDescriptor, int writeFD, unsigned char * outBuff){
+  //the size and type of the file
+  struct stat info;
+  //the mapping
+  char * map;
+  //the blocks the threads share
+  struct blockJob job;
+  //the threads
+  pthread_t * pool = NULL;
+  int threads = blockThreads;
+  //loop counters and block boundaries
+  int i;
+  long start;
+  long end;
+  //the header and the frames
+  unsigned char frame[HCZ_FRAME_SIZE];
+  //whether writing the file failed
+  int failed = 0;
+  //the offset of the next frame in the .hcz file
+  unsigned long long offset = HCZ_HEADER_SIZE;
+  //the index that goes at the end of the file
+  unsigned char * index;
+  //writes straight to the end of the .hcz file, retrying short writes
+  struct byteWriter writer;
+  //only regular files can be mapped
+  if(fstat(fileDescriptor, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0){
+    return compressionFileReader(fileDescriptor, writeFD, outBuff);
+  }
+  map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+  if(map == MAP_FAILED){
+    return compressionFileReader(fileDescriptor, writeFD, outBuff);
+  }
+  madvise(map, info.st_size, MADV_SEQUENTIAL);
+  //count the blocks, every block ends right after the first delimiter past blockSize bytes
+  memset(&job, 0x0, sizeof(struct blockJob));
+  if(info.st_size/blockSize + 1 > INT_MAX){
+    printf("ERROR: Too many blocks, use a bigger -B\n");
+    munmap(map, info.st_size);
     return 1;
   }
-  //counter to loop through the buffer
-  int counter = 0;
-  //counter to loop through the cdata
-  int localcount = 0;
-  //find the escaping sequence first allocate space for it
-  escapeSequence = (char *) malloc(50*sizeof(char));
-  //throw an error in case this fails
-  if(!escapeSequence){
-    //print an ERROR
-    printf("FATAL ERROR: Not enough space on the heap/n");
-    //return unsuccessful
+  job.blocks = (struct hczBlock *)calloc(info.st_size/blockSize + 1, sizeof(struct hczBlock));
+  if(!job.blocks){
+    printf("FATAL ERROR: Not enough memory\n");
+    munmap(map, info.st_size);
     return 1;
   }
-  //memset the escape sequence to be null
-  memset(escapeSequence, '\0', 50);
-  //loop through the characters until you hit the first new line
-  while(buff[counter] != '\n'){
-    //store the characters in the escaping sequence one by one
-    escapeSequence[counter] = buff[counter];
-    //increment the counter
-    counter++;
+  for(start = 0; start < info.st_size; start = end){
+    end = start + blockSize < info.st_size ? start + blockSize : info.st_size;
+    //don't cut a token in half
+    while(end < info.st_size && map[end-1] != ' ' && map[end-1] != '\t' && map[end-1] != '\n'){
+      end++;
+    }
+    job.blocks[job.count].start = map + start;
+    job.blocks[job.count].length = end - start;
+    job.count++;
   }
-  //this value stores the character at counter
-  char ctemp;
-  //this value indicates wether we are reading a token or bit sequence
-  int indicator = 0;
-  //allocate starting space into cdata
-  char *cdata = (char *)malloc(11*sizeof(char));
-  char *bdata = (char *)malloc(11*sizeof(char));
-  //used temporarily for reallocing memory
-  char *temp;
-  //check if the pointer is null
-  if(!cdata || !bdata){
-    //print an error
-    printf("FATAL ERROR: Not enough space on heap\n");
-    //return unsuccessful
-    return 1;
+  //make space for the index and its footer
+  index = (unsigned char *)malloc((size_t)job.count*HCZ_INDEX_ENTRY + HCZ_FOOTER_SIZE);
+  if(!index){
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(1);
   }
-  //set the array to be all null terminators
-  memset(cdata, '\0', 11);
-  memset(bdata, '\0', 11);
-  //initial sizes
-  int cSize = 10;
-  int bSize = 10;
-  //skip the fnewline char at the end of the first line
-  counter ++;
-  //loop through the string until we hit a terminator which means end of the buffer and text file
-  while(buff[counter] != '\0'){
-    //store the current value of the buffer at counter
-    ctemp = buff[counter];
-    //check if we have hit a newline
-    if(ctemp == '\n') { 
-    	// dont need to store empty tokens TODO: add this to the decompress method
-    	if(strcmp(cdata, "") != 0) {
-        //null terminate our bdata
-        cdata[localcount] = '\0';
-        //insert our bitcode and token into the hashtable
-    		if(hInsert(cdata, bdata)){
-          //print an error
-          printf("ERROR: Unable to insert %s into our huffman table", cdata);
-          //return unnsuccessful
-          return 1;
-        }
-    		// allocate new space
-    		cdata = (char *)malloc(11*sizeof(char));
-    		bdata = (char *)malloc(11*sizeof(char)); 
-        //set the characters to null terminators
-    		memset(cdata, '\0', 11);
-    		memset(bdata, '\0', 11);
-        //reset the sizes with one space for the null terminator
-        bSize = 10;
-        cSize = 10;
-        //flip indicator back
-        indicator = 0;
-    	}
-      //reset the local count
-    	localcount = -1;
-    } else if(ctemp == '\t'){ //check if we have hit a tab
-      //next we need the cdata
-      indicator = 1;
-      //we don't need to store empty tokens
-     	if(strcmp(bdata, "") == 0){
-        //we failed to read the bdata
-        printf("WARNING: Codebook formatted incorrectly, compression will not work with only one element in the codebook\n");
-        //return unsuccessful
-        return 1;
-      }
-      //reset the local count
-      localcount = -1;
-      //dont need Adviths switch statements, huffman codebook formatted properly
-    } else if(indicator) { // we are dealing with the token
-      //check to see if there is still space in the character array
-    	if(localcount >= cSize){
-    		//temporarily relocate the existing characters
-    		temp = cdata;
-        //allocate more space for the token
-    		cdata = (char*)malloc((cSize+10)*sizeof(char));
-        //checks make sure there is space
-    		if(cdata == NULL) {
-          //there's no space
-    			printf("ERROR: Not enough space on heap\n");
-          //return unsuccessfull
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.finished, NULL);
+  //there's no point in more threads than blocks
+  if(threads > job.count){
+    threads = job.count;
+  }
+  //with more than one thread the blocks are coded in the background while we write them, a few blocks ahead at most
+  job.window = 2*threads;
+  if(threads > 1){
+    pool = (pthread_t *)malloc(threads*sizeof(pthread_t));
+    if(!pool){
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(1);
+    }
+    for(i = 0; i < threads; i++){
+      if(pthread_create(&pool[i], NULL, blockThread, &job)){
+        printf("FATAL ERROR: Unable to start a worker thread\n");
+        exit(1);
+      }
+    }
+  }
+  //write the header, the last bits byte isn't used since every block knows its own bit length
+  memcpy(outBuff, HCZ_MAGIC, 3);
+  outBuff[3] = HCZ_BLOCK_VERSION;
+  outBuff[4] = 0;
+  writer.fd = writeFD;
+  writer.buff = NULL;
+  writer.used = 0;
+  writer.offset = -1;
+  failed = byteWriterWrite(&writer, (char *)outBuff, HCZ_HEADER_SIZE);
+  //write the blocks out in order
+  for(i = 0; i < job.count; i++){
+    if(threads > 1){
+      //wait for the block to be coded
+      pthread_mutex_lock(&job.lock);
+      while(!job.blocks[i].done){
+        pthread_cond_wait(&job.finished, &job.lock);
+      }
+      pthread_mutex_unlock(&job.lock);
+    } else if(encodeBlock(&job.blocks[i], outBuff)){
+      //code it ourselves
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(1);
+    }
+    //add the block to the index
+    storeLE64(index + (size_t)i*HCZ_INDEX_ENTRY, offset);
+    storeLE64(index + (size_t)i*HCZ_INDEX_ENTRY + 8, job.blocks[i].bitLength);
+    storeLE64(index + (size_t)i*HCZ_INDEX_ENTRY + 16, job.blocks[i].length);
+    offset += HCZ_FRAME_SIZE + job.blocks[i].outSize;
+    //frame the block with its bit length
+    storeLE64(frame, job.blocks[i].bitLength);
+    if(!failed){
+      failed = byteWriterWrite(&writer, (char *)frame, HCZ_FRAME_SIZE) || byteWriterWrite(&writer, (char *)job.blocks[i].out, job.blocks[i].outSize);
+    }
+    //the block is out, the threads can code one more
+    free(job.blocks[i].out);
+    job.blocks[i].out = NULL;
+    if(threads > 1){
+      pthread_mutex_lock(&job.lock);
+      job.written = i+1;
+      pthread_cond_broadcast(&job.finished);
+      pthread_mutex_unlock(&job.lock);
+    }
+  }
+  //close off the blocks
+  storeLE64(frame, HCZ_END_FRAME);
+  if(!failed){
+    failed = byteWriterWrite(&writer, (char *)frame, HCZ_FRAME_SIZE);
+  }
+  //the index goes after the end frame followed by the footer
+  offset += HCZ_FRAME_SIZE;
+  storeLE64(index + (size_t)job.count*HCZ_INDEX_ENTRY, job.count);
+  storeLE64(index + (size_t)job.count*HCZ_INDEX_ENTRY + 8, offset);
+  memcpy(index + (size_t)job.count*HCZ_INDEX_ENTRY + 16, HCZ_INDEX_MAGIC, 4);
+  if(!failed){
+    failed = byteWriterWrite(&writer, (char *)index, (long)job.count*HCZ_INDEX_ENTRY + HCZ_FOOTER_SIZE);
+  }
+  free(index);
+  //wait for the threads
+  if(threads > 1){
+    for(i = 0; i < threads; i++){
+      pthread_join(pool[i], NULL);
+    }
+    free(pool);
+  }
+  //clean up
+  pthread_mutex_destroy(&job.lock);
+  pthread_cond_destroy(&job.finished);
+  free(job.blocks);
+  munmap(map, info.st_size);
+  //check if a write failed
+  if(failed){
+    printf("ERROR: Unable to write to the .hcz file\n");
+  }
+  return failed;
+}
+
+/* a block thread keeps coding the next block until there are none left, staying at most window blocks ahead of the writer */
+void * blockThread(void * arg){
+  //the blocks we share
+  struct blockJob * job = (struct blockJob *)arg;
+  //the block to code
+  int index;
+  //the thread's packing buffer
+  unsigned char * buff = (unsigned char *)malloc(IO_BUFFER_SIZE);
+  if(!buff){
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(1);
+  }
+  while(1){
+    //take the next block once the writer has caught up enough, so coded blocks don't pile up in memory
+    pthread_mutex_lock(&job -> lock);
+    while(job -> next < job -> count && job -> next >= job -> written + job -> window){
+      pthread_cond_wait(&job -> finished, &job -> lock);
+    }
+    index = job -> next++;
+    pthread_mutex_unlock(&job -> lock);
+    //check if we're done
+    if(index >= job -> count){
+      break;
+    }
+    //code it
+    if(encodeBlock(&job -> blocks[index], buff)){
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(1);
+    }
+    //let the writer know
+    pthread_mutex_lock(&job -> lock);
+    job -> blocks[index].done = 1;
+    pthread_cond_broadcast(&job -> finished);
+    pthread_mutex_unlock(&job -> lock);
+  }
+  free(buff);
+  return NULL;
+}
+
+/* codes the block into memory, the last byte is padded with zeros */
+int encodeBlock(struct hczBlock * block, unsigned char * buff){
+  //packs the codes into memory
+  struct bitWriter writer;
+  bitWriterOpen(&writer, -1, buff);
+  //every block ends after a delimiter, so it's a complete chunk
+  if(savTokenizer((char *)block -> start, block -> length, &writer)){
+    free(writer.mem);
+    return 1;
+  }
+  //count the bits before padding the last byte
+  block -> bitLength = (unsigned long long)writer.bytes*8 + writer.count;
+  if((writer.count > 0 && bitWriterPutBits(&writer, 0, 8 - writer.count)) || bitWriterFlush(&writer)){
+    free(writer.mem);
+    return 1;
+  }
+  //the block keeps the bytes
+  block -> out = writer.mem;
+  block -> outSize = writer.memUsed;
+  return 0;
+}
+
+/* stores the value in 8 bytes, least significant byte first */
+void storeLE64(unsigned char * dest, unsigned long long value){
+  int i;
+  for(i = 0; i < 8; i++){
+    dest[i] = (unsigned char)(value >> (8*i));
+  }
+}
+
+/* reads a value stored by storeLE64 */
+unsigned long long loadLE64(const unsigned char * src){
+  unsigned long long value = 0;
+  int i;
+  for(i = 7; i >= 0; i--){
+    value = (value << 8) | src[i];
+  }
+  return value;
+}
+
+/* turns a size like 4M, 512K or 65536 into bytes, returns -1 if it isn't one */
+long parseSize(const char * text){
+  //where the number stops
+  char * rest;
+  long size = strtol(text, &rest, 10);
+  //apply the suffix
+  if(*rest == 'k' || *rest == 'K'){
+    size *= 1024;
+    rest++;
+  } else if(*rest == 'm' || *rest == 'M'){
+    size *= 1024*1024;
+    rest++;
+  }
+  //anything else makes it invalid
+  if(rest == text || *rest != '\0'){
+    return -1;
+  }
+  return size;
+}
+
+/* hands the complete tokens of a chunk to savTokenizer, returns how much of the chunk was used */
+int compressChunk(char * buff, int length, int isLast, void * context){
+  //only tokens followed by a delimiter are complete, unless the file is over
+  int end = isLast ? length : lastDelimiter(buff, length, " \t\n");
+  //tokenize the complete part
+  if(savTokenizer(buff, end, (struct bitWriter *)context)){
+    return -1;
+  }
+  //the rest is carried over to the next chunk
+  return end;
+}
+
+/* After reading the complete contents of a given file(in this case the text file we want compressed), we need to split the file up into tokens
+and then load each token into the linked list.  This is also a modified version of Adviths tokenizer */
+int savTokenizer (char *buff, int buffSize, struct bitWriter *writer){
+  //counter to loop through the buffer
+  int counter;
+  //where the current token starts
+  int start = 0;
+  //finds the delimiters a block at a time
+  struct delimiterScanner scan;
+  scannerInit(&scan, buff, buffSize);
+  //jump from delimiter to delimiter
+  while((counter = scannerNext(&scan)) < buffSize){
+    //we don't need to write empty tokens, the token is written straight out of the buffer
+    if(counter > start && compressionWriter(&buff[start], counter-start, writer)){
+      return 1;
+    }
+    //the whitespace character is a token of its own
+    if(compressionWriter(&buff[counter], 1, writer)){
+      return 1;
+    }
+    //the next token starts after it
+    start = counter+1;
+  }
+  //we have reached the end put the last guy in there
+  if(buffSize > start && compressionWriter(&buff[start], buffSize-start, writer)){
+    return 1;
+  }
+  //return success!
+  return 0;
+}
+
+/*given the token (a slice of the input, not null terminated) and the bit writer, this method packs the token's bitcode into the .hcz file*/
+int compressionWriter(char * token, int length, struct bitWriter * writer){
+  //the slot of the token
+  struct tableEntry * entry;
+  //index
+  int k;
+  //binary codebooks are looked up in their own hash index
+  if(binBook){
+    //find the token, tokens the codebook doesn't know are written out as literals
+    k = binaryLookup(binBook, token, length);
+    if(k < 0){
+      return literalWriter(token, length, writer);
+    }
+    //pack its code
+    if(bitWriterPutBits(writer, binBook -> codes[k], binBook -> lengths[k])){
+      //the write failed
+      printf("ERROR: Unable to write to the .hcz file\n");
+      //return unsuccessful
+      return 1;
+    }
+    //success!
+    return 0;
+  }
+  //check to see if the table has anything in it
+  if(huffmanTable.used == 0){
+    //there is an error
+    printf("ERROR: Codebook mismatch, your codebook might be empty\n");
+    //exit this badboy
+    exit(0);
+  }
+  //find the token in the table, tokens the codebook doesn't know are written out as literals
+  entry = mapFind(&huffmanTable, token, length, hashToken(token, length));
+  if(!(entry -> key)){
+    return literalWriter(token, length, writer);
+  }
+  //we need to write our bitcode
+  if(bitWriterPutBits(writer, entry -> value, entry -> bits)){
+    //the write failed
+    printf("ERROR: Unable to write to the .hcz file\n");
+    //return unsuccessful
+    return 1;
+  }
+  //success!
+  return 0;
+}
+
+/* writes a token missing from the codebook as the escape code, its length as an Elias gamma code and then its raw bytes */
+int literalWriter(char * token, int length, struct bitWriter * writer){
+  //the escape code and its length
+  unsigned long long code;
+  int codeLen;
+  //the slot of the escape code
+  struct tableEntry * entry;
+  int k;
+  //the number of bits in the length
+  int lenBits = 0;
+  //loop counter
+  int i;
+  //find the escape code
+  if(binBook){
+    k = binaryLookup(binBook, ESCAPE_TOKEN, 2);
+    code = k >= 0 ? binBook -> codes[k] : 0;
+    codeLen = k >= 0 ? binBook -> lengths[k] : 0;
+  } else{
+    entry = mapFind(&huffmanTable, ESCAPE_TOKEN, 2, hashToken(ESCAPE_TOKEN, 2));
+    code = entry -> key ? entry -> value : 0;
+    codeLen = entry -> key ? entry -> bits : 0;
+  }
+  //older codebooks don't have one, the token can't be written without losing it
+  if(codeLen == 0){
+    printf("ERROR: %.*s is not in the codebook and the codebook has no escape code, rebuild it with -b\n", length > 64 ? 64 : length, token);
+    return 1;
+  }
+  //count the bits of the length
+  while(lenBits < 31 && ((unsigned int)length >> lenBits) > 1){
+    lenBits++;
+  }
+  //the escape code, the bits of the length as zeros, then the length itself
+  if(bitWriterPutBits(writer, code, codeLen) || (lenBits > 0 && bitWriterPutBits(writer, 0, lenBits)) || bitWriterPutBits(writer, length, lenBits+1)){
+    printf("ERROR: Unable to write to the .hcz file\n");
+    return 1;
+  }
+  //the raw bytes follow, four at a time while we can
+  for(i = 0; i + 4 <= length; i += 4){
+    if(bitWriterPutBits(writer, (unsigned long long)(unsigned char)token[i] << 24 | (unsigned char)token[i+1] << 16 | (unsigned char)token[i+2] << 8 | (unsigned char)token[i+3], 32)){
+      printf("ERROR: Unable to write to the .hcz file\n");
+      return 1;
+    }
+  }
+  for(; i < length; i++){
+    if(bitWriterPutBits(writer, (unsigned char)token[i], 8)){
+      printf("ERROR: Unable to write to the .hcz file\n");
+      return 1;
+    }
+  }
+  //success!
+  return 0;
+}
+
+/* gets the bit writer ready for the first code, with fd -1 the bytes are collected in memory */
+void bitWriterOpen(struct bitWriter * writer, int fd, unsigned char * buff){
+  //the writer starts out with an empty register and buffer
+  writer -> fd = fd;
+  writer -> acc = 0;
+  writer -> count = 0;
+  writer -> buff = buff;
+  writer -> used = 0;
+  writer -> bytes = 0;
+  writer -> mem = NULL;
+  writer -> memUsed = 0;
+  writer -> memCap = 0;
+}
+
+/* puts the .hcz header in the buffer and gets the bit writer ready for the first code */
+int bitWriterInit(struct bitWriter * writer, int fd, unsigned char * buff){
+  //the writer starts out empty
+  bitWriterOpen(writer, fd, buff);
+  //fill in the magic string
+  memcpy(buff, HCZ_MAGIC, 3);
+  //the version of the format
+  buff[3] = HCZ_VERSION;
+  //we don't know the valid bits yet, bitWriterFinish patches this
+  buff[4] = 0;
+  //the header is the first thing in the buffer
+  writer -> used = HCZ_HEADER_SIZE;
+  writer -> bytes = HCZ_HEADER_SIZE;
+  //success!
+  return 0;
+}
+
+/* packs the lowest length bits of value (at most 56) into the writer */
+int bitWriterPutBits(struct bitWriter * writer, unsigned long long value, int length){
+  //shift the register over and add the new bits at the bottom
+  writer -> acc = (writer -> acc << length) | value;
+  writer -> count += length;
+  //move every whole byte into the buffer
+  while(writer -> count >= 8){
+    writer -> count -= 8;
+    writer -> buff[writer -> used++] = (unsigned char)(writer -> acc >> writer -> count);
+    writer -> bytes++;
+    //check if the buffer is full
+    if(writer -> used == IO_BUFFER_SIZE && bitWriterFlush(writer)){
+      //the write failed
+      return 1;
+    }
+  }
+  //success!
+  return 0;
+}
+
+/* writes every packed byte in the buffer to the file (or to memory without one) */
+int bitWriterFlush(struct bitWriter * writer){
+  //the number of bytes written so far
+  int written = 0;
+  //the status of the last write
+  int status;
+  //temp for growing the memory
+  unsigned char * temp;
+  //without a file the bytes are appended to memory
+  if(writer -> fd < 0){
+    //double the memory until the buffer fits
+    if(writer -> memUsed + writer -> used > writer -> memCap){
+      writer -> memCap = writer -> memCap ? writer -> memCap*2 : IO_BUFFER_SIZE;
+      while(writer -> memUsed + writer -> used > writer -> memCap){
+        writer -> memCap *= 2;
+      }
+      temp = (unsigned char *)realloc(writer -> mem, writer -> memCap);
+      if(!temp){
+        return 1;
+      }
+      writer -> mem = temp;
+    }
+    memcpy(writer -> mem + writer -> memUsed, writer -> buff, writer -> used);
+    writer -> memUsed += writer -> used;
+    writer -> used = 0;
+    return 0;
+  }
+  //keep writing until the buffer is empty
+  while(written < writer -> used){
+    status = write(writer -> fd, writer -> buff + written, writer -> used - written);
+    //check for errors
+    if(status <= 0){
+      return 1;
+    }
+    written += status;
+  }
+  //the buffer is empty again
+  writer -> used = 0;
+  //success!
+  return 0;
+}
+
+/* writes the last partial byte and records the number of valid bits in it in the header */
+int bitWriterFinish(struct bitWriter * writer){
+  //the number of valid bits in the last byte (0 means the file has no codes)
+  unsigned char lastBits = 0;
+  //check if there is a partial byte left
+  if(writer -> count > 0){
+    //remember how many of its bits are real
+    lastBits = writer -> count;
+    //pad the rest of the byte with zeros
+    if(bitWriterPutBits(writer, 0, 8 - writer -> count)){
+      return 1;
+    }
+  } else if(writer -> bytes > HCZ_HEADER_SIZE){
+    //the last byte was completely full
+    lastBits = 8;
+  }
+  //write out everything that is left
+  if(bitWriterFlush(writer)){
+    return 1;
+  }
+  //patch the header now that we know the valid bits of the last byte
+  if(pwrite(writer -> fd, &lastBits, 1, HCZ_HEADER_SIZE-1) != 1){
+    //the write failed
+    return 1;
+  }
+  //success!
+  return 0;
+}
+
+/* Read the given file descriptor and write each item to the huffman table */
+int huffmanCodebookReader (int fileDescriptor){
+  //what we remember between chunks of the codebook
+  struct codebookState state;
+  //binary codebooks are mapped and used as they are
+  binBook = openBinaryCodebook(fileDescriptor);
+  if(binBook){
+    //nothing else to read
+    return 0;
+  }
+  //every token goes into the huffman table
+  memset(&state, 0x0, sizeof(struct codebookState));
+  state.insert = hInsert;
+  //stream the codebook through the tokenizer one chunk at a time
+  if(streamFile(fileDescriptor, codebookChunk, &state) || finishCodebook(&state)){
+    //there was an error
+    printf("ERROR: Unable to tokenize given codebook\n");
+    //return unsuccessful
+    return 1;
+  }
+  //success!
+  return 0;
+}
+
+/* hands the complete lines of a codebook chunk to huffTokenizer, returns how much of the chunk was used */
+int codebookChunk(char * buff, int length, int isLast, void * context){
+  //only lines ending in a newline are complete, unless the file is over
+  int end = isLast ? length : lastDelimiter(buff, length, "\n");
+  //tokenize the complete part
+  if(huffTokenizer(buff, end, (struct codebookState *)context)){
+    return -1;
+  }
+  //the rest is carried over to the next chunk
+  return end;
+}
+
+/*this method will be for going through the complete lines of a huffman codebook, used when compressing and decompressing*/
+int huffTokenizer (char *buff, int buffSize, struct codebookState * state){
+  //counter to loop through the buffer
+  int counter = 0;
+  //the end of the current line and the tab inside it
+  char * lineEnd;
+  char * tab;
+  //the bitcode (or length) and token of the line
+  char * bdata;
+  char * cdata;
+  //the length of the token
+  int tokenLen;
+  //the first line holds the escaping sequence
+  if(!(state -> started)){
+    //find the escaping sequence first allocate space for it
+    escapeSequence = (char *) malloc(50*sizeof(char));
+    //throw an error in case this fails
+    if(!escapeSequence){
+      //print an ERROR
+      printf("FATAL ERROR: Not enough space on the heap\n");
+      //return unsuccessful
+      return 1;
+    }
+    //memset the escape sequence to be null
+    memset(escapeSequence, '\0', 50);
+    //loop through the characters until you hit the first new line or tab
+    while(counter < buffSize && counter < 49 && buff[counter] != '\n' && buff[counter] != '\t'){
+      //store the characters in the escaping sequence one by one
+      escapeSequence[counter] = buff[counter];
+      //increment the counter
+      counter++;
+    }
+    //canonical codebooks mark themselves after the escape sequence
+    state -> canonical = counter+10 <= buffSize && buff[counter] == '\t' && strncmp(&buff[counter+1], "canonical", 9) == 0;
+    //skip the rest of the first line
+    while(counter < buffSize && buff[counter] != '\n'){
+      counter++;
+    }
+    //skip the newline too
+    counter++;
+    state -> started = 1;
+  }
+  //go through the codebook one line at a time
+  while(counter < buffSize){
+    //find the end of the line
+    lineEnd = memchr(&buff[counter], '\n', buffSize - counter);
+    if(!lineEnd){
+      //the last line has no newline
+      lineEnd = &buff[buffSize];
+    }
+    //the bitcode and the token are split by a tab
+    tab = memchr(&buff[counter], '\t', lineEnd - &buff[counter]);
+    //skip empty lines
+    if(lineEnd == &buff[counter]){
+      counter++;
+      continue;
+    }
+    //a line without a bitcode is broken
+    if(!tab || tab == &buff[counter]){
+      //we failed to read the bdata
+      printf("WARNING: Codebook formatted incorrectly, compression will not work with only one element in the codebook\n");
+      //return unsuccessful
+      return 1;
+    }
+    //whitespace tokens are stored as the escaping sequence (on its own it stands for a space, followed by n or t for newlines and tabs,
+    //followed by e it is the escape code for tokens missing from the codebook)
+    tokenLen = lineEnd - (tab+1);
+    if(tokenLen >= (int)strlen(escapeSequence) && tokenLen <= (int)strlen(escapeSequence)+1 && strncmp(tab+1, escapeSequence, strlen(escapeSequence)) == 0
+        && (tokenLen == (int)strlen(escapeSequence) || tab[1+tokenLen-1] == 'n' || tab[1+tokenLen-1] == 't' || tab[1+tokenLen-1] == 'e')){
+      //turn it back into the whitespace character or the key of the escape code
+      if(tokenLen == (int)strlen(escapeSequence)){
+        cdata = arenaString(&codebookArena, " ", 1);
+      } else if(tab[tokenLen] == 'e'){
+        cdata = arenaString(&codebookArena, ESCAPE_TOKEN, 2);
+      } else{
+        cdata = arenaString(&codebookArena, tab[tokenLen] == 'n' ? "\n" : "\t", 1);
+      }
+    } else{
+      //copy the token
+      cdata = arenaString(&codebookArena, tab+1, tokenLen);
+    }
+    //copy the bitcode
+    bdata = arenaString(&codebookArena, &buff[counter], tab - &buff[counter]);
+    //check for memory
+    if(!cdata || !bdata){
+      //print an error
+      printf("FATAL ERROR: Not enough space on heap\n");
+      //return unsuccessful
+      return 1;
+    }
+    //we don't need to store empty tokens
+    if(tokenLen == 0){
+      //the arena takes care of the copies
+    } else if(state -> canonical){ //canonical codebooks only give us the length, the code comes later
+      //remember the token and its length
+      if(canonAdd(&(state -> pending), cdata, atoi(bdata), 0)){
+        //no space
+        printf("FATAL ERROR: Not enough space on heap\n");
+        return 1;
+      }
+    } else if(state -> insert(cdata, bdata)){ //insert our bitcode and token
+      //print an error
+      printf("ERROR: Unable to insert %s into our huffman table\n", cdata);
+      //return unnsuccessful
+      return 1;
+    }
+    //move on to the next line
+    counter = lineEnd - buff + 1;
+  }
+  return 0;
+}
+
+/* hands out the codes of a canonical codebook once every length has been read */
+int finishCodebook(struct codebookState * state){
+  //the codes handed out to the pending tokens
+  unsigned int * codes;
+  //loop counter
+  int i;
+  //check to see that we had something in the codebook
+  if(!(state -> started)){
+    //print an error
+    printf("WARNING: Empty codebook\n");
+    //return unsuccessfull
+    return 1;
+  }
+  //codebooks with full codes are done already
+  if(!(state -> canonical)){
+    return 0;
+  }
+  //hand out the codes
+  codes = canonCodes(&(state -> pending));
+  //check that the lengths made sense
+  if(!codes){
+    printf("ERROR: Codebook lengths do not form a valid code\n");
+    return 1;
+  }
+  //insert every token with its code
+  for(i = 0; i < state -> pending.count; i++){
+    if(state -> insert(state -> pending.tokens[i], codeString(&codebookArena, codes[i], state -> pending.lengths[i]))){
+      //print an error
+      printf("ERROR: Unable to insert %s into our huffman table\n", state -> pending.tokens[i]);
+      return 1;
+    }
+  }
+  //the tokens and code strings live in the codebook arena
+  free(codes);
+  free(state -> pending.tokens);
+  free(state -> pending.lengths);
+  free(state -> pending.weights);
+  return 0;
+}
+
+/* this method will take the token and bitcode of the token and insert them into the hashtable */
+int hInsert (char * name, char * bitname) {
+  //the slot of the token
+  struct tableEntry * entry;
+  //whether the token was already in the table
+  int found;
+  //the table starts out empty the first time we insert into it
+  if(!huffmanTable.slots && mapInit(&huffmanTable, 1024)){
+    //no space
+    printf("FATAL ERROR: Not enough space on the heap");
+    //return unsuccessful
+    return 1;
+  }
+  //find or make the slot for the token
+  entry = mapInsert(&huffmanTable, name, strlen(name), &found);
+  //memory error
+  if(!entry){
+    //no space
+    printf("FATAL ERROR: Not enough space on the heap");
+    //return unsuccessful
+    return 1;
+  }
+  //turn the bitcode into an integer once so compressing only has to shift it in, a token listed twice keeps its last code
+  entry -> value = 0;
+  entry -> bits = 0;
+  while(*bitname == '0' || *bitname == '1'){
+    entry -> value = (entry -> value << 1) | (*bitname == '1');
+    entry -> bits++;
+    bitname++;
+  }
+  //the code has to fit in the register of the bit writer
+  if(*bitname != '\0' || entry -> bits > 56){
+    printf("ERROR: Invalid bitcode for %s in the codebook\n", name);
+    return 1;
+  }
+  //success!
+  return 0;
+}
+
+/* Reads the given codebook and builds the decode tables */
+int codebookReader (int fileDescriptor){
+  //what we remember between chunks of the codebook
+  struct codebookState state;
+  //binary codebooks are mapped and handed to the decoder as they are
+  struct binaryCodebook * book = openBinaryCodebook(fileDescriptor);
+  if(book){
+    //the decoder points into the mapping so it stays mapped until freeDecoder
+    binBook = book;
+    return binaryDecoder(book);
+  }
+  //every token goes to the decoder
+  memset(&state, 0x0, sizeof(struct codebookState));
+  state.insert = decoderInsert;
+  //stream the codebook through the tokenizer one chunk at a time
+  if(streamFile(fileDescriptor, codebookChunk, &state) || finishCodebook(&state)){
+    //there was an error
+    return 1;
+  }
+  //turn the codes we collected into the decode tables
+  return buildDecodeTables();
+}
+
+/*hands a token and its bitcode from the codebook to the decoder*/
+int decoderInsert(char * token, char * code){
+  //the bitcode as an integer
+  unsigned long long value = 0;
+  int length = 0;
+  if(!code){
+    return 1;
+  }
+  //turn the '0' and '1' characters into bits once
+  while(*code == '0' || *code == '1'){
+    value = (value << 1) | (*code == '1');
+    length++;
+    code++;
+  }
+  //the code has to fit in the register of the bit writer, just like when compressing
+  if(*code != '\0' || length > 56){
+    return 1;
+  }
+  //the token lives in the codebook arena
+  return decoderAddCode(value, length, token, strlen(token));
+}
+
+/*stores a token and its bitcode in the decoder, the token is not copied*/
+int decoderAddCode(unsigned long long code, int codeLen, char * token, int tokenLen){
+  //temp for growing the arrays
+  void * temp;
+  //codes without any bits can never show up in a .hcz file
+  if(codeLen == 0){
+    //nothing to store
+    return 0;
+  }
+  //check if we need more room for the symbols
+  if(myDecoder -> numSymbols >= myDecoder -> symCap){
+    //double the capacity
+    myDecoder -> symCap = myDecoder -> symCap ? myDecoder -> symCap*2 : 1024;
+    //grow every symbol array
+    temp = realloc(myDecoder -> symbols, myDecoder -> symCap*sizeof(char *));
+    if(!temp){
+      return 1;
+    }
+    myDecoder -> symbols = temp;
+    temp = realloc(myDecoder -> symbolLens, myDecoder -> symCap*sizeof(int));
+    if(!temp){
+      return 1;
+    }
+    myDecoder -> symbolLens = temp;
+    temp = realloc(myDecoder -> codes, myDecoder -> symCap*sizeof(unsigned long long));
+    if(!temp){
+      return 1;
+    }
+    myDecoder -> codes = temp;
+    temp = realloc(myDecoder -> codeLens, myDecoder -> symCap);
+    if(!temp){
+      return 1;
+    }
+    myDecoder -> codeLens = temp;
+  }
+  //the token stays where it is
+  myDecoder -> symbols[myDecoder -> numSymbols] = token;
+  myDecoder -> symbolLens[myDecoder -> numSymbols] = tokenLen;
+  myDecoder -> codes[myDecoder -> numSymbols] = code;
+  myDecoder -> codeLens[myDecoder -> numSymbols] = codeLen;
+  //one more symbol
+  myDecoder -> numSymbols++;
+  //success!
+  return 0;
+}
+
+/*orders symbol indices by their bitcode so codes sharing a prefix sit next to each other*/
+int codeCompare(const void * a, const void * b){
+  //the symbols being compared
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  //line both codes up on the left so the bits compare in order, a prefix goes first
+  unsigned long long left = myDecoder -> codes[x] << (64 - myDecoder -> codeLens[x]);
+  unsigned long long right = myDecoder -> codes[y] << (64 - myDecoder -> codeLens[y]);
+  if(left != right){
+    return left < right ? -1 : 1;
+  }
+  return myDecoder -> codeLens[x] - myDecoder -> codeLens[y];
+}
+
+/*returns the value of count bits of the code of length bits starting at bit start, missing bits are zero*/
+int codeBits(unsigned long long code, int length, int start, int count){
+  //line the code up on the left and drop the bits before start
+  unsigned long long bits = (code << (64 - length)) << start;
+  //take the top count bits
+  return count > 0 ? (int)(bits >> (64 - count)) : 0;
+}
+
+/*builds the decode tables out of the codes collected from the codebook*/
+int buildDecodeTables(){
+  //symbol indices sorted by their codes
+  int * order;
+  //the symbol arrays rearranged into code order
+  char ** symbols;
+  int * symbolLens;
+  unsigned long long * codes;
+  unsigned char * codeLens;
+  //loop counter and the symbol before it
+  int i;
+  int prev;
+  //an empty codebook can't decode anything
+  if(myDecoder -> numSymbols == 0){
+    //print an error
+    printf("WARNING: Empty codebook\n");
+    return 1;
+  }
+  //canonical codebooks list their codes in order already, so only sort if a code comes before the one ahead of it
+  for(i = 1; i < myDecoder -> numSymbols; i++){
+    prev = i-1;
+    if(codeCompare(&prev, &i) > 0){
+      break;
+    }
+  }
+  if(i < myDecoder -> numSymbols){
+    //make room for the order and the rearranged arrays
+    order = (int *)malloc(myDecoder -> numSymbols*sizeof(int));
+    symbols = (char **)malloc(myDecoder -> numSymbols*sizeof(char *));
+    symbolLens = (int *)malloc(myDecoder -> numSymbols*sizeof(int));
+    codes = (unsigned long long *)malloc(myDecoder -> numSymbols*sizeof(unsigned long long));
+    codeLens = (unsigned char *)malloc(myDecoder -> numSymbols);
+    if(!order || !symbols || !symbolLens || !codes || !codeLens){
+      //no space
+      printf("FATAL ERROR: Not enough memory\n");
+      return 1;
+    }
+    //start with the order the codebook gave us
+    for(i = 0; i < myDecoder -> numSymbols; i++){
+      order[i] = i;
+    }
+    //sort the symbols by their codes
+    qsort(order, myDecoder -> numSymbols, sizeof(int), codeCompare);
+    //rearrange the symbols so the symbol index is its position in code order
+    for(i = 0; i < myDecoder -> numSymbols; i++){
+      symbols[i] = myDecoder -> symbols[order[i]];
+      symbolLens[i] = myDecoder -> symbolLens[order[i]];
+      codes[i] = myDecoder -> codes[order[i]];
+      codeLens[i] = myDecoder -> codeLens[order[i]];
+    }
+    //swap in the sorted arrays
+    free(myDecoder -> symbols);
+    free(myDecoder -> symbolLens);
+    free(myDecoder -> codes);
+    free(myDecoder -> codeLens);
+    myDecoder -> symbols = symbols;
+    myDecoder -> symbolLens = symbolLens;
+    myDecoder -> codes = codes;
+    myDecoder -> codeLens = codeLens;
+    myDecoder -> symCap = myDecoder -> numSymbols;
+    //we don't need the order anymore
+    free(order);
+  }
+  //remember where the escape code ended up
+  myDecoder -> escape = -1;
+  for(i = 0; i < myDecoder -> numSymbols; i++){
+    if(myDecoder -> symbolLens[i] == 2 && memcmp(myDecoder -> symbols[i], ESCAPE_TOKEN, 2) == 0){
+      myDecoder -> escape = i;
+    }
+  }
+  //build the root table and every sub table below it
+  buildDecodeLevel(0, myDecoder -> numSymbols, 0, &(myDecoder -> rootBits));
+  //success!
+  return 0;
+}
+
+/*builds the table for the sorted codes lo to hi which share their first depth bits, returns where the table starts*/
+int buildDecodeLevel(int lo, int hi, int depth, int * tableBits){
+  //loop counters
+  int i;
+  int j;
+  //the longest code in this range
+  int maxLen = 0;
+  //the index of the code in the table
+  int index;
+  //number of bits and start of a sub table
+  int subBits;
+  int sub;
+  //the number of table slots a short code covers
+  int fill;
+  //where our table starts
+  int base = myDecoder -> used;
+  //temp for growing the table
+  struct decodeEntry * temp;
+  //find the longest code
+  for(i = lo; i < hi; i++){
+    if(myDecoder -> codeLens[i] > maxLen){
+      maxLen = myDecoder -> codeLens[i];
+    }
+  }
+  //the table is indexed by at most DECODE_BITS bits
+  *tableBits = maxLen - depth;
+  if(*tableBits > DECODE_BITS){
+    *tableBits = DECODE_BITS;
+  }
+  //check if there is space for the table
+  while(myDecoder -> used + (1 << *tableBits) > myDecoder -> cap){
+    //double the space for the tables
+    myDecoder -> cap = myDecoder -> cap ? myDecoder -> cap*2 : 4096;
+    temp = realloc(myDecoder -> table, myDecoder -> cap*sizeof(struct decodeEntry));
+    if(!temp){
+      //no space
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(0);
+    }
+    myDecoder -> table = temp;
+  }
+  //every slot starts off empty so bad codes are caught
+  memset(&(myDecoder -> table[base]), 0x0, (1 << *tableBits)*sizeof(struct decodeEntry));
+  myDecoder -> used += 1 << *tableBits;
+  //go through the codes in order
+  i = lo;
+  while(i < hi){
+    //find the slot of the code
+    index = codeBits(myDecoder -> codes[i], myDecoder -> codeLens[i], depth, *tableBits);
+    //check if the code ends in this table
+    if(myDecoder -> codeLens[i] - depth <= *tableBits){
+      //the code covers every slot that starts with it
+      fill = 1 << (*tableBits - (myDecoder -> codeLens[i] - depth));
+      for(j = 0; j < fill; j++){
+        myDecoder -> table[base+index+j].type = DECODE_SYMBOL;
+        myDecoder -> table[base+index+j].value = i;
+        myDecoder -> table[base+index+j].bits = myDecoder -> codeLens[i] - depth;
+      }
+      i++;
+    } else{
+      //find all the long codes that share this slot
+      j = i+1;
+      while(j < hi && myDecoder -> codeLens[j] - depth > *tableBits && codeBits(myDecoder -> codes[j], myDecoder -> codeLens[j], depth, *tableBits) == index){
+        j++;
+      }
+      //they get a sub table of their own
+      sub = buildDecodeLevel(i, j, depth + *tableBits, &subBits);
+      //link the slot to the sub table
+      myDecoder -> table[base+index].type = DECODE_LINK;
+      myDecoder -> table[base+index].value = sub;
+      myDecoder -> table[base+index].bits = subBits;
+      i = j;
+    }
+  }
+  return base;
+}
+
+/* this method traverses the files array and decompresses all of them on the given number of threads*/
+int decompressFiles(int numOfFiles, int threads){
+  //with fewer files than threads, the threads decompress the blocks of one file at a time instead
+  if(numOfFiles < threads){
+    blockThreads = threads;
+    threads = 1;
+  }
+  //decompress every .hcz file
+  return runFileJob(numOfFiles, threads, decompressFile, 2*IO_BUFFER_SIZE);
+}
+
+/* decompresses the file at the given index if it is a .hcz file, the scratch space holds an input and an output buffer */
+int decompressFile(int i, unsigned char * scratch){
+  //the input and output buffers
+  unsigned char * inBuff = scratch;
+  unsigned char * outBuff = scratch + IO_BUFFER_SIZE;
+  //counter and other stuff
+  char filePath[PATH_MAX+1];
+  char fileType[5];
+  int length;
+  int fd;
+  int writefd;
+  //the text is decoded into a temp file next to it, so a broken .hcz never wipes out the old text
+  char tempPath[PATH_MAX+8];
+  //whether decoding failed
+  int failed;
+  //calculate the index of the point
+  length = strlen(files[i]);
+  //check to see if the path is even valid
+  if(length < 5){
+    return 0;
+  }
+  //split the path and type
+  strncpy(fileType, &files[i][length-4], 4);
+  //null terminate the filetype
+  fileType[4] = '\0';
+  strncpy(filePath, files[i], length-4);
+  //we need to add a null terminator to the filepath
+  filePath[length-4] = '\0';
+  //check if the file is an hcz file
+  if(strcmp(fileType, ".hcz") == 0){
+    //open the huffman codebook file
+    fd = open(files[i], O_RDONLY);
+    //also open the temp file to write
+    sprintf(tempPath, "%s.XXXXXX", filePath);
+    writefd = fd < 0 ? -1 : mkstemp(tempPath);
+    //check to see if there was trouble opening either file
+    if(fd < 0 || writefd < 0){
+      //print error
+      printf("ERROR: Unable to open the %dth compressed file\n", i);
+      if(fd >= 0){
+        close(fd);
+      }
+      return 1;
+    }
+    //pass it into the readHcz method to be read, the text only replaces the old one once it is complete
+    failed = readHcz(fd, writefd, inBuff, (char *)outBuff);
+    //close both file descriptors once we are done using them
+    close(fd);
+    close(writefd);
+    if(failed || rename(tempPath, filePath) < 0){
+      //error while trying to decompress a file
+      printf("ERROR: Unable to decompress file %d\n", i);
+      unlink(tempPath);
+      return 1;
+    }
+  }
+  //success!
+  return 0;
+}
+
+/*loads whole bytes from the file into the reader until the register is full or the file runs out*/
+int bitReaderFill(struct bitReader * reader){
+  //keep at least one free byte in the register
+  while(reader -> count <= 56 && reader -> bytesLeft > 0){
+    //check if we used up the bytes we read in bulk
+    if(reader -> buffPos >= reader -> buffUsed){
+      //read the next block of the file
+      reader -> buffUsed = read(reader -> fd, reader -> buff, IO_BUFFER_SIZE);
+      reader -> buffPos = 0;
+      //check if the file ended early
+      if(reader -> buffUsed <= 0){
+        return 1;
+      }
+    }
+    //place the next byte right under the bits we already have
+    reader -> acc |= (unsigned long long)reader -> buff[reader -> buffPos++] << (56 - reader -> count);
+    reader -> count += 8;
+    reader -> bytesLeft--;
+  }
+  //success!
+  return 0;
+}
+
+/*copies the given bytes into the writer and writes the buffer out whenever it fills up*/
+int byteWriterPut(struct byteWriter * writer, char * data, int length){
+  //check if the bytes fit in the buffer
+  if(writer -> used + length > IO_BUFFER_SIZE){
+    //make room by writing out what we have
+    if(byteWriterFlush(writer)){
+      return 1;
+    }
+    //bytes bigger than the whole buffer go straight to the file
+    if(length > IO_BUFFER_SIZE){
+      return byteWriterWrite(writer, data, length);
+    }
+  }
+  //add the bytes to the buffer
+  memcpy(writer -> buff + writer -> used, data, length);
+  writer -> used += length;
+  //success!
+  return 0;
+}
+
+/*writes everything in the buffer to the file*/
+int byteWriterFlush(struct byteWriter * writer){
+  //write the buffer out
+  if(byteWriterWrite(writer, writer -> buff, writer -> used)){
+    return 1;
+  }
+  //the buffer is empty again
+  writer -> used = 0;
+  //success!
+  return 0;
+}
+
+/*writes the bytes to the end of the file, or at the writer's offset when it has one*/
+int byteWriterWrite(struct byteWriter * writer, char * data, long length){
+  //the number of bytes written so far
+  long written = 0;
+  //the status of the last write
+  ssize_t status;
+  //keep writing until everything is out
+  while(written < length){
+    if(writer -> offset < 0){
+      status = write(writer -> fd, data + written, length - written);
+    } else{
+      status = pwrite(writer -> fd, data + written, length - written, writer -> offset);
+    }
+    //check for errors
+    if(status <= 0){
+      return 1;
+    }
+    written += status;
+    //move the offset along
+    if(writer -> offset >= 0){
+      writer -> offset += status;
+    }
+  }
+  //success!
+  return 0;
+}
+
+/*Reads the given .hcz file with the given reusable buffers, returns 0 on success*/
+int readHcz(int readFD, int writeFD, unsigned char * inBuff, char * outBuff){
+  //the header holds the magic, the version and the valid bits of the last byte
+  unsigned char header[HCZ_HEADER_SIZE];
+  //the bit length in front of a block
+  unsigned char frame[HCZ_FRAME_SIZE];
+  unsigned long long bitLength;
+  //stores the size of the .hcz file
+  struct stat fileStat;
+  //pulls the bits out of the file
+  struct bitReader reader;
+  //collects the tokens we decode
+  struct byteWriter writer;
+  //read in the header
+  if(read(readFD, header, HCZ_HEADER_SIZE) != HCZ_HEADER_SIZE || memcmp(header, HCZ_MAGIC, 3) != 0 || (header[3] != HCZ_VERSION && header[3] != HCZ_BLOCK_VERSION) || header[4] > 8){
+    //this is not a packed .hcz file
+    printf("ERROR: Not a valid .hcz file\n");
+    return 1;
+  }
+  //find the size of the file to know where the bits end
+  if(fstat(readFD, &fileStat) < 0){
+    //we could not stat the file
+    return 1;
+  }
+  //the reader starts out empty
+  reader.fd = readFD;
+  reader.acc = 0;
+  reader.count = 0;
+  reader.bytesLeft = fileStat.st_size - HCZ_HEADER_SIZE;
+  reader.buff = inBuff;
+  reader.buffPos = 0;
+  reader.buffUsed = 0;
+  //the writer starts out empty too
+  writer.fd = writeFD;
+  writer.buff = outBuff;
+  writer.used = 0;
+  writer.offset = -1;
+  //indexed block files can be decoded on several threads at once
+  if(header[3] == HCZ_BLOCK_VERSION && blockThreads > 1 && fileStat.st_size >= HCZ_HEADER_SIZE + HCZ_FRAME_SIZE + HCZ_FOOTER_SIZE){
+    switch(readIndexedHcz(readFD, writeFD, fileStat.st_size)){
+      case 0:
+        //success!
+        return 0;
+      case 1:
+        //the blocks were broken
+        return 1;
+    }
+    //there's no index, read the blocks one after the other
+  }
+  //check how the bits are laid out
+  if(header[3] == HCZ_VERSION){
+    //every byte after the header is full except for the last one
+    reader.bitsLeft = reader.bytesLeft*8;
+    //take away the padding of the last byte
+    if(reader.bitsLeft > 0){
+      reader.bitsLeft -= 8 - header[4];
+    }
+    //decode the whole stream
+    if(decodeBits(&reader, &writer)){
+      return 1;
+    }
+  } else{
+    //decode one block at a time until the end frame
+    while(1){
+      //read the bit length of the block
+      if(bitReaderBytes(&reader, frame, HCZ_FRAME_SIZE)){
+        printf("Warning: .hcz file is truncated\n");
+        return 1;
+      }
+      bitLength = loadLE64(frame);
+      //check if we're done
+      if(bitLength == HCZ_END_FRAME){
+        break;
+      }
+      //the block is padded to whole bytes
+      reader.bitsLeft = bitLength;
+      reader.bytesLeft = (bitLength+7)/8;
+      if(decodeBits(&reader, &writer)){
+        return 1;
+      }
+      //drop the padding of the block
+      reader.acc = 0;
+      reader.count = 0;
+    }
+  }
+  //write out whatever tokens are still in the buffer
+  if(byteWriterFlush(&writer)){
+    //the write failed
+    printf("ERROR: Unable to write the decompressed file\n");
+    return 1;
+  }
+  //success!
+  return 0;
+}
+
+/* maps an indexed block file and decodes its blocks on blockThreads threads, each block is written straight to its place
+in the output with pwrite. Returns 0 on success, 1 if decoding failed and 2 if the file has no usable index */
+int readIndexedHcz(int readFD, int writeFD, long fileSize){
+  //the mapped file
+  unsigned char * map;
+  //the footer fields
+  unsigned long long count;
+  unsigned long long indexOffset;
+  //the blocks the threads share
+  struct decodeJob job;
+  //the threads
+  pthread_t * pool;
+  int threads = blockThreads;
+  //loop counter
+  int i;
+  //the end of the text so far and the extent of a block
+  long total = 0;
+  unsigned long long frameOffset;
+  unsigned long long bitLength;
+  unsigned long long outSize;
+  //the longest token the decoder can write for a single bit
+  int maxLen = 1;
+  //map the whole file
+  map = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, readFD, 0);
+  if(map == MAP_FAILED){
+    return 2;
+  }
+  //check the footer
+  count = loadLE64(map + fileSize - HCZ_FOOTER_SIZE);
+  indexOffset = loadLE64(map + fileSize - HCZ_FOOTER_SIZE + 8);
+  if(memcmp(map + fileSize - 4, HCZ_INDEX_MAGIC, 4) != 0 || indexOffset > (unsigned long long)fileSize - HCZ_FOOTER_SIZE
+      || count != ((unsigned long long)fileSize - HCZ_FOOTER_SIZE - indexOffset)/HCZ_INDEX_ENTRY || count > INT_MAX){
+    munmap(map, fileSize);
+    return 2;
+  }
+  memset(&job, 0x0, sizeof(struct decodeJob));
+  job.map = map;
+  job.index = map + indexOffset;
+  job.count = count;
+  job.writeFD = writeFD;
+  //work out where the text of every block goes
+  job.outOffsets = (long *)malloc((count+1)*sizeof(long));
+  if(!job.outOffsets){
+    printf("FATAL ERROR: Not enough memory\n");
+    munmap(map, fileSize);
+    return 1;
+  }
+  for(i = 0; i < myDecoder -> numSymbols; i++){
+    if(myDecoder -> symbolLens[i] > maxLen){
+      maxLen = myDecoder -> symbolLens[i];
+    }
+  }
+  for(i = 0; i < job.count; i++){
+    frameOffset = loadLE64(job.index + i*HCZ_INDEX_ENTRY);
+    bitLength = loadLE64(job.index + i*HCZ_INDEX_ENTRY + 8);
+    outSize = loadLE64(job.index + i*HCZ_INDEX_ENTRY + 16);
+    //make sure the block is inside the file and its text is no longer than its bits could decode to
+    if(frameOffset < HCZ_HEADER_SIZE || frameOffset + HCZ_FRAME_SIZE > indexOffset || (bitLength+7)/8 > indexOffset - frameOffset - HCZ_FRAME_SIZE
+        || loadLE64(map + frameOffset) != bitLength || outSize/maxLen > bitLength || outSize > (unsigned long long)(LONG_MAX - total)){
+      printf("ERROR: Not a valid .hcz file\n");
+      free(job.outOffsets);
+      munmap(map, fileSize);
+      return 1;
+    }
+    job.outOffsets[i] = total;
+    total += outSize;
+  }
+  //the output has its final size before any block is written
+  job.outOffsets[job.count] = total;
+  if(ftruncate(writeFD, total) != 0){
+    printf("ERROR: Unable to write the decompressed file\n");
+    free(job.outOffsets);
+    munmap(map, fileSize);
+    return 1;
+  }
+  pthread_mutex_init(&job.lock, NULL);
+  //there's no point in more threads than blocks
+  if(threads > job.count){
+    threads = job.count;
+  }
+  if(threads <= 1){
+    decodeThread(&job);
+  } else{
+    pool = (pthread_t *)malloc(threads*sizeof(pthread_t));
+    if(!pool){
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(1);
+    }
+    for(i = 0; i < threads; i++){
+      if(pthread_create(&pool[i], NULL, decodeThread, &job)){
+        printf("FATAL ERROR: Unable to start a worker thread\n");
+        exit(1);
+      }
+    }
+    for(i = 0; i < threads; i++){
+      pthread_join(pool[i], NULL);
+    }
+    free(pool);
+  }
+  //don't leave a file full of holes behind if a block failed
+  if(job.failed && ftruncate(writeFD, 0) != 0){
+    printf("ERROR: Unable to write the decompressed file\n");
+  }
+  //clean up
+  pthread_mutex_destroy(&job.lock);
+  free(job.outOffsets);
+  munmap(map, fileSize);
+  return job.failed;
+}
+
+/* a decode thread keeps decoding the next block of the job straight out of the mapping until there are none left */
+void * decodeThread(void * arg){
+  //the blocks we share
+  struct decodeJob * job = (struct decodeJob *)arg;
+  //the block to decode
+  int index;
+  //pulls the bits out of the block
+  struct bitReader reader;
+  //writes the block's text to its place in the output
+  struct byteWriter writer;
+  //the thread's output buffer
+  char * outBuff = (char *)malloc(IO_BUFFER_SIZE);
+  if(!outBuff){
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(1);
+  }
+  while(1){
+    //take the next block
+    pthread_mutex_lock(&job -> lock);
+    index = job -> next++;
+    pthread_mutex_unlock(&job -> lock);
+    //check if we're done
+    if(index >= job -> count){
+      break;
+    }
+    //the reader works straight off the mapped bytes of the block, so it never reads the file
+    reader.fd = -1;
+    reader.acc = 0;
+    reader.count = 0;
+    reader.bitsLeft = loadLE64(job -> index + index*HCZ_INDEX_ENTRY + 8);
+    reader.bytesLeft = (reader.bitsLeft+7)/8;
+    reader.buff = (unsigned char *)job -> map + loadLE64(job -> index + index*HCZ_INDEX_ENTRY) + HCZ_FRAME_SIZE;
+    reader.buffPos = 0;
+    reader.buffUsed = reader.bytesLeft;
+    //the writer starts at the block's place in the output
+    writer.fd = job -> writeFD;
+    writer.buff = outBuff;
+    writer.used = 0;
+    writer.offset = job -> outOffsets[index];
+    //decode it and make sure it filled exactly its part of the output
+    if(decodeBits(&reader, &writer) || byteWriterFlush(&writer) || writer.offset != job -> outOffsets[index+1]){
+      printf("ERROR: Unable to decompress block %d\n", index);
+      pthread_mutex_lock(&job -> lock);
+      job -> failed = 1;
+      pthread_mutex_unlock(&job -> lock);
+    }
+  }
+  free(outBuff);
+  return NULL;
+}
+
+/* copies the next length bytes of the file that are not part of the codes (like block frames) out of the reader */
+int bitReaderBytes(struct bitReader * reader, unsigned char * dest, int length){
+  //the number of bytes we can take from the buffer at once
+  int size;
+  while(length > 0){
+    //check if we used up the bytes we read in bulk
+    if(reader -> buffPos >= reader -> buffUsed){
+      //read the next block of the file
+      reader -> buffUsed = read(reader -> fd, reader -> buff, IO_BUFFER_SIZE);
+      reader -> buffPos = 0;
+      //check if the file ended early
+      if(reader -> buffUsed <= 0){
+        return 1;
+      }
+    }
+    size = reader -> buffUsed - reader -> buffPos < length ? reader -> buffUsed - reader -> buffPos : length;
+    memcpy(dest, reader -> buff + reader -> buffPos, size);
+    reader -> buffPos += size;
+    dest += size;
+    length -= size;
+  }
+  //success!
+  return 0;
+}
+
+/* decodes the next bitsLeft bits of the reader and writes the tokens to the writer */
+int decodeBits(struct bitReader * reader, struct byteWriter * writer){
+  //the table entry we looked up
+  struct decodeEntry entry;
+  //the table we are looking in and the number of bits it is indexed by
+  int base;
+  int bits;
+  //start in the root table
+  base = 0;
+  bits = myDecoder -> rootBits;
+  //loop through the bitcode in the hcz file
+  while(reader -> bitsLeft > 0){
+    //make sure there are enough bits in the register for the lookup
+    if(reader -> count < bits && bitReaderFill(reader)){
+      //the file ended early
+      printf("Warning: .hcz file is truncated\n");
+      return 1;
+    }
+    //peek at the next bits, missing bits at the very end read as zeros
+    entry = myDecoder -> table[base + (int)(reader -> acc >> (64 - bits))];
+    //check what we found
+    if(entry.type == DECODE_LINK && bits < reader -> bitsLeft){
+      //the code is longer, consume the bits and look in the sub table
+      reader -> acc <<= bits;
+      reader -> count -= bits;
+      reader -> bitsLeft -= bits;
+      base = entry.value;
+      bits = entry.bits;
+    } else if(entry.type == DECODE_SYMBOL && entry.bits <= reader -> bitsLeft){
+      //consume only the bits of the code
+      reader -> acc <<= entry.bits;
+      reader -> count -= entry.bits;
+      reader -> bitsLeft -= entry.bits;
+      //the escape code is followed by a literal token
+      if(entry.value == myDecoder -> escape){
+        if(decodeLiteral(reader, writer)){
           return 1;
-    		}
-        //increase the space used by our token
-        cSize += 10;
-        //set the token to null terminators
-    		memset(cdata, '\0', cSize);
-        //copy the temp stuff back into our cdata
-    		memcpy(cdata, temp, localcount);
-        //TODO: remember to free temp in the decompress tokenizer
-    		free(temp);
-    	}
-      //check the escaping sequence
-      if(ctemp == escapeSequence[localcount]){
-        //check to see if the rest of the escaping sequence is also present
-        if(strncmp(escapeSequence, &buff[counter], strlen(escapeSequence)) == 0){
-          //we need to escape sequence with one of the following
-          if(buff[counter+strlen(escapeSequence)] == 'n'){
-          //store the newline character in cdata
-          cdata[0] = '\n';
-          //skip the rest of the escape sequence
-          counter += strlen(escapeSequence);
-        } else if(buff[counter+strlen(escapeSequence)] == '\n'){
-          //store the space character in cdata
-          cdata[0] = ' ';
-          //skip the rest of the escape sequence
-          counter += strlen(escapeSequence)-1;
-        } else if(buff[counter+strlen(escapeSequence)] == 't'){
-          //store the tab character in cdata
-          cdata[0] = '\t';
-          //skip the rest of the escape sequence
-          counter += strlen(escapeSequence);
         }
+      } else if(byteWriterPut(writer, myDecoder -> symbols[entry.value], myDecoder -> symbolLens[entry.value])){ //we need to write the token to the output buffer
+        //the write failed
+        printf("ERROR: Unable to write the decompressed file\n");
+        return 1;
+      }
+      //go back to the root table
+      base = 0;
+      bits = myDecoder -> rootBits;
+    } else{
+      //there's something wrong
+      printf("Warning: Codebook mismatch\n");
+      exit(1);
+    }
+  }
+  //success!
+  return 0;
+}
+
+/* takes the next count (1 to 32) code bits out of the reader */
+int bitReaderTake(struct bitReader * reader, int count, unsigned int * value){
+  //make sure there are enough bits in the register and in the stream
+  if((reader -> count < count && bitReaderFill(reader)) || reader -> bitsLeft < count){
+    printf("Warning: .hcz file is truncated\n");
+    return 1;
+  }
+  //the bits are at the top of the register
+  *value = (unsigned int)(reader -> acc >> (64 - count));
+  reader -> acc <<= count;
+  reader -> count -= count;
+  reader -> bitsLeft -= count;
+  return 0;
+}
+
+/* reads the Elias gamma length and the raw bytes that follow an escape code and writes them to the writer */
+int decodeLiteral(struct bitReader * reader, struct byteWriter * writer){
+  //the bytes of the literal, written a piece at a time
+  char bytes[256];
+  int used = 0;
+  //the length of the literal and the number of bits after its leading one
+  unsigned int length;
+  unsigned int bit;
+  int lenBits = 0;
+  //count the zeros before the length
+  do{
+    if(bitReaderTake(reader, 1, &bit)){
+      return 1;
+    }
+  } while(bit == 0 && ++lenBits < 32);
+  //a length can't have that many bits
+  if(bit == 0 || lenBits > 30){
+    printf("Warning: Codebook mismatch\n");
+    return 1;
+  }
+  //the rest of the length follows the leading one
+  length = 1;
+  if(lenBits > 0){
+    if(bitReaderTake(reader, lenBits, &bit)){
+      return 1;
+    }
+    length = length << lenBits | bit;
+  }
+  //copy out the raw bytes
+  while(length > 0){
+    if(bitReaderTake(reader, 8, &bit)){
+      return 1;
+    }
+    bytes[used++] = (char)bit;
+    length--;
+    //write the piece once it fills up or the literal is over
+    if((used == (int)sizeof(bytes) || length == 0) && byteWriterPut(writer, bytes, used)){
+      printf("ERROR: Unable to write the decompressed file\n");
+      return 1;
+    }
+    if(used == (int)sizeof(bytes)){
+      used = 0;
+    }
+  }
+  //success!
+  return 0;
+}
+
+/* sorts the vocabulary and merges it with two queues (the leaves and the internal nodes, which are made in order of
+weight) to find the huffman code length of every token in linear time, the lengths go into the code list.
+Only the topK most frequent tokens seen at least minFreq times are kept (0 keeps them all) */
+int huffmanLengths(int topK, long minFreq){
+  //the sorted leaves
+  int n;
+  struct leaf * leaves = sortLeaves(&n);
+  //the weights of the internal nodes in the order they are made
+  long * internal;
+  //the parent of every node, leaves are 0..n-1 and internal nodes n..2n-2, later reused for depths
+  int * parent;
+  //the fronts of the two queues and the number of internal nodes made
+  int leaf = 0;
+  int head = 0;
+  int made;
+  //the two nodes being merged
+  int pick;
+  int j;
+  //loop counter
+  int i;
+  if(!leaves){
+    return 1;
+  }
+  //drop the rare tokens
+  keepLeaves(leaves, &n, topK, minFreq);
+  //a lone token still needs one bit, and there's nothing to do without tokens
+  if(n <= 1){
+    if(n == 1 && canonAdd(codeList, leaves[0].key, 1, leaves[0].value)){
+      return 1;
+    }
+    free(leaves);
+    return 0;
+  }
+  internal = (long *)malloc((n-1)*sizeof(long));
+  parent = (int *)malloc((2*n-1)*sizeof(int));
+  if(!internal || !parent){
+    return 1;
+  }
+  //every step merges the two lightest nodes at the fronts of the queues, leaves win ties
+  for(made = 0; made < n-1; made++){
+    internal[made] = 0;
+    for(j = 0; j < 2; j++){
+      if(leaf < n && (head >= made || leaves[leaf].value <= internal[head])){
+        pick = leaf;
+        internal[made] += leaves[leaf++].value;
+      } else{
+        pick = n + head;
+        internal[made] += internal[head++];
+      }
+      parent[pick] = n + made;
+    }
+  }
+  //parents are always made after their children, so walking down from the root gives every depth
+  parent[2*n-2] = 0;
+  for(i = 2*n-3; i >= 0; i--){
+    parent[i] = parent[parent[i]] + 1;
+  }
+  //the depth of every leaf is its code length
+  for(i = 0; i < n; i++){
+    if(canonAdd(codeList, leaves[i].key, parent[i], leaves[i].value)){
+      return 1;
+    }
+  }
+  //clean up
+  free(internal);
+  free(parent);
+  free(leaves);
+  return 0;
+}
+
+/* returns the tokens of the vocabulary ordered by (frequency, hash, token) and sets count to their number.
+It's a radix sort on the frequency and hash, only runs of tokens with the same frequency and hash are compared,
+so the order doesn't depend on where the tokens landed in the table (which differs between serial and threaded builds) */
+struct leaf * sortLeaves(int * count){
+  //the leaves and the buffer the passes move them to, a spilled build already has most of its leaves
+  struct leaf * leaves = (struct leaf *)realloc(runLeaves, (numRunLeaves+vocab.table.used+1)*sizeof(struct leaf));
+  struct leaf * other = (struct leaf *)malloc((numRunLeaves+vocab.table.used+1)*sizeof(struct leaf));
+  struct leaf * temp;
+  //the number of leaves of every byte value and where they go
+  int buckets[256];
+  //the biggest frequency, passes over bytes above it are skipped
+  long largest = 0;
+  //the byte we are sorting by
+  int shift;
+  int digit;
+  //loop counters
+  int i;
+  int j;
+  int n = numRunLeaves;
+  if(!leaves || !other){
+    return NULL;
+  }
+  //the leaves of the merged run belong to us now
+  runLeaves = NULL;
+  numRunLeaves = 0;
+  for(i = 0; i < n; i++){
+    if(leaves[i].value > largest){
+      largest = leaves[i].value;
+    }
+  }
+  //collect the used slots
+  for(i = 0; i < vocab.table.cap; i++){
+    if(vocab.table.slots[i].key){
+      leaves[n].value = vocab.table.slots[i].value;
+      leaves[n].hash = vocab.table.slots[i].hash;
+      leaves[n].key = vocab.table.slots[i].key;
+      if(leaves[n].value > largest){
+        largest = leaves[n].value;
+      }
+      n++;
+    }
+  }
+  //the least significant bytes go first: four bytes of hash, then the bytes of the frequency
+  for(shift = 0; shift < 32 || (shift < 96 && (largest >> (shift-32)) > 0); shift += 8){
+    //count the leaves of every byte value
+    memset(buckets, 0x0, sizeof(buckets));
+    for(i = 0; i < n; i++){
+      digit = shift < 32 ? (leaves[i].hash >> shift) & 0xFF : (leaves[i].value >> (shift-32)) & 0xFF;
+      buckets[digit]++;
+    }
+    //turn the counts into starting positions
+    for(i = 0, j = 0; i < 256; i++){
+      digit = buckets[i];
+      buckets[i] = j;
+      j += digit;
+    }
+    //move the leaves over, keeping the order of the last pass
+    for(i = 0; i < n; i++){
+      digit = shift < 32 ? (leaves[i].hash >> shift) & 0xFF : (leaves[i].value >> (shift-32)) & 0xFF;
+      other[buckets[digit]++] = leaves[i];
+    }
+    temp = leaves;
+    leaves = other;
+    other = temp;
+  }
+  free(other);
+  //tokens with the same frequency and hash are put in order by the token
+  for(i = 0; i < n; i = j){
+    for(j = i+1; j < n && leaves[j].value == leaves[i].value && leaves[j].hash == leaves[i].hash; j++);
+    if(j - i > 1){
+      qsort(&leaves[i], j - i, sizeof(struct leaf), leafCompare);
+    }
+  }
+  *count = n;
+  return leaves;
+}
+
+/*orders leaves with the same frequency and hash by their token*/
+int leafCompare(const void * a, const void * b){
+  return strcmp(((const struct leaf *)a) -> key, ((const struct leaf *)b) -> key);
+}
+
+/* drops the sorted leaves seen fewer than minFreq times and all but the topK most frequent ones (0 keeps them all).
+The escape code is always kept and takes over the frequency of the dropped tokens, since each of them is written with it */
+int keepLeaves(struct leaf * leaves, int * count, int topK, long minFreq){
+  //the number of leaves, the one of the escape code and the number we drop
+  int n = *count;
+  int escape = -1;
+  int drop = 0;
+  //the escape leaf with its new frequency
+  struct leaf kept;
+  //loop counters
+  int i;
+  int j;
+  //find the escape code
+  for(i = 0; i < n; i++){
+    if(strcmp(leaves[i].key, "$e") == 0){
+      escape = i;
+    }
+  }
+  //nothing to do without an escape code to fall back on
+  if(escape < 0){
+    return 0;
+  }
+  //the rarest tokens are at the front
+  while(drop < n && leaves[drop].value < minFreq){
+    drop++;
+  }
+  while(topK > 0 && n - drop - (escape >= drop) > topK){
+    drop++;
+  }
+  //the escape code is written once for every dropped token
+  kept = leaves[escape];
+  for(i = 0; i < drop; i++){
+    if(i != escape){
+      kept.value += leaves[i].value;
+    }
+  }
+  //move the tokens we keep to the front, leaving the escape code out
+  for(i = drop, j = 0; i < n; i++){
+    if(i != escape){
+      leaves[j++] = leaves[i];
+    }
+  }
+  //put the escape code back where its new frequency belongs, keeping the (frequency, hash, token) order
+  while(j > 0 && (leaves[j-1].value > kept.value || (leaves[j-1].value == kept.value && (leaves[j-1].hash > kept.hash
+      || (leaves[j-1].hash == kept.hash && strcmp(leaves[j-1].key, kept.key) > 0))))){
+    leaves[j] = leaves[j-1];
+    j--;
+  }
+  leaves[j] = kept;
+  *count = n - drop + (escape < drop);
+  return 0;
+}
+
+/* hashes the bytes of a token (64 bit FNV-1a with a final mix), shared by every table that looks tokens up */
+uint32_t hashToken(const char * token, int length){
+  //the FNV offset basis
+  uint64_t hash = 1469598103934665603ULL;
+  //loop counter
+  int i;
+  //fold in every byte
+  for(i = 0; i < length; i++){
+    hash ^= (unsigned char)token[i];
+    hash *= 1099511628211ULL;
+  }
+  //mix the high bits into the low ones
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return (uint32_t)hash;
+}
+
+/* writes the sorted code list as a binary codebook: header, offsets, codes, lengths, hash index and string pool */
+int writeBinaryCodebook(int fd, struct canonList * sorted, unsigned int * codes){
+  //the header of the file
+  struct binaryHeader header;
+  //the arrays of the file
+  uint32_t * offsets;
+  uint32_t * intCodes;
+  uint8_t * lengths;
+  uint32_t * index;
+  char * pool;
+  //the whole file is put together in one buffer
+  char * image;
+  size_t imageSize;
+  size_t lengthsSize;
+  //the raw bytes of a token, the codebook stores "$", "$n" and "$t" for whitespace
+  char * token;
+  int tokenLen;
+  //the slot a token hashes to
+  uint32_t slot;
+  //loop counter
+  int i;
+  //fill in the header
+  memcpy(header.magic, HCB_MAGIC, 4);
+  header.count = sorted -> count;
+  header.poolSize = 0;
+  header.maxLength = 0;
+  //find the most space the pool could need and the longest code
+  for(i = 0; i < sorted -> count; i++){
+    header.poolSize += strlen(sorted -> tokens[i]);
+    if((uint32_t)sorted -> lengths[i] > header.maxLength){
+      header.maxLength = sorted -> lengths[i];
+    }
+  }
+  //keep the index at most half full
+  header.indexSize = 1;
+  while(header.indexSize < 2*header.count){
+    header.indexSize *= 2;
+  }
+  //the lengths are padded so the index stays aligned
+  lengthsSize = (header.count + 3) & ~3;
+  imageSize = sizeof(struct binaryHeader) + (header.count+1)*4 + header.count*4 + lengthsSize + header.indexSize*4 + header.poolSize;
+  image = (char *)calloc(1, imageSize);
+  if(!image){
+    return 1;
+  }
+  //find where every array goes
+  offsets = (uint32_t *)(image + sizeof(struct binaryHeader));
+  intCodes = offsets + header.count + 1;
+  lengths = (uint8_t *)(intCodes + header.count);
+  index = (uint32_t *)(lengths + lengthsSize);
+  pool = (char *)(index + header.indexSize);
+  //fill in every token
+  offsets[0] = 0;
+  for(i = 0; i < sorted -> count; i++){
+    //turn the whitespace names back into the whitespace itself
+    token = sorted -> tokens[i];
+    if(strcmp(token, "$") == 0){
+      token = " ";
+    } else if(strcmp(token, "$n") == 0){
+      token = "\n";
+    } else if(strcmp(token, "$t") == 0){
+      token = "\t";
+    } else if(strcmp(token, "$e") == 0){
+      token = ESCAPE_TOKEN;
+    }
+    tokenLen = strlen(token);
+    //copy the token into the pool
+    memcpy(pool + offsets[i], token, tokenLen);
+    offsets[i+1] = offsets[i] + tokenLen;
+    //the code is already a number
+    intCodes[i] = codes[i];
+    lengths[i] = sorted -> lengths[i];
+    //put the token in the first free slot starting from its hash
+    slot = hashToken(token, tokenLen) & (header.indexSize - 1);
+    while(index[slot] != 0){
+      slot = (slot + 1) & (header.indexSize - 1);
+    }
+    index[slot] = i + 1;
+  }
+  //the pool only holds the bytes we copied, whitespace tokens shrank to one byte
+  header.poolSize = offsets[sorted -> count];
+  imageSize = (pool - image) + header.poolSize;
+  //the header goes in last now that it is complete
+  memcpy(image, &header, sizeof(struct binaryHeader));
+  //write the whole codebook with one call
+  if(write(fd, image, imageSize) != (ssize_t)imageSize){
+    free(image);
+    return 1;
+  }
+  //we're done with the image
+  free(image);
+  //success!
+  return 0;
+}
+
+/* maps a binary codebook into memory, returns NULL if the file is not a binary codebook */
+struct binaryCodebook * openBinaryCodebook(int fd){
+  //stores the size of the codebook
+  struct stat fileStat;
+  //the magic at the start of the file
+  char magic[4];
+  //the mapped codebook
+  struct binaryCodebook * book;
+  //the header of the mapping
+  struct binaryHeader * header;
+  //size of the padded lengths
+  size_t lengthsSize;
+  //walks the arrays while checking them
+  uint32_t i;
+  //check the magic without moving the file offset
+  if(pread(fd, magic, 4, 0) != 4 || memcmp(magic, HCB_MAGIC, 4) != 0 || fstat(fd, &fileStat) < 0){
+    return NULL;
+  }
+  //make space for the codebook
+  book = (struct binaryCodebook *)malloc(sizeof(struct binaryCodebook));
+  if(!book){
+    return NULL;
+  }
+  //map the whole file, nothing has to be parsed
+  book -> mapSize = fileStat.st_size;
+  book -> map = mmap(NULL, book -> mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(book -> map == MAP_FAILED || book -> mapSize < sizeof(struct binaryHeader)){
+    free(book);
+    return NULL;
+  }
+  //the index must be a power of two with at least one empty slot, and every array has to fit in the file
+  header = (struct binaryHeader *)book -> map;
+  lengthsSize = ((size_t)header -> count + 3) & ~(size_t)3;
+  if(header -> indexSize == 0 || (header -> indexSize & (header -> indexSize - 1)) != 0 || header -> indexSize <= header -> count || header -> maxLength > MAX_CODE_LENGTH
+     || sizeof(struct binaryHeader) + ((size_t)header -> count + 1)*4 + (size_t)header -> count*4 + lengthsSize + (size_t)header -> indexSize*4 + header -> poolSize > book -> mapSize){
+    munmap(book -> map, book -> mapSize);
+    free(book);
+    return NULL;
+  }
+  //find every array
+  book -> header = header;
+  book -> offsets = (uint32_t *)((char *)book -> map + sizeof(struct binaryHeader));
+  book -> codes = book -> offsets + header -> count + 1;
+  book -> lengths = (uint8_t *)(book -> codes + header -> count);
+  book -> index = (uint32_t *)(book -> lengths + lengthsSize);
+  book -> pool = (char *)(book -> index + header -> indexSize);
+  //the tokens must follow each other through the pool and their codes must fit in maxLength bits
+  for(i = 0; i < header -> count; i++){
+    if(book -> offsets[i+1] < book -> offsets[i] || book -> lengths[i] < 1 || book -> lengths[i] > header -> maxLength || (book -> lengths[i] < 32 && (book -> codes[i] >> book -> lengths[i]) != 0)){
+      break;
+    }
+  }
+  if(i < header -> count || book -> offsets[0] != 0 || book -> offsets[header -> count] != header -> poolSize){
+    munmap(book -> map, book -> mapSize);
+    free(book);
+    return NULL;
+  }
+  //every slot of the index has to be empty or point at a token
+  for(i = 0; i < header -> indexSize; i++){
+    if(book -> index[i] > header -> count){
+      munmap(book -> map, book -> mapSize);
+      free(book);
+      return NULL;
+    }
+  }
+  //the mapping is ready to use
+  return book;
+}
+
+/* finds the given token in a binary codebook, returns its position or -1 if it is not there */
+int binaryLookup(struct binaryCodebook * book, const char * token, int length){
+  //mask for wrapping around the index
+  uint32_t mask = book -> header -> indexSize - 1;
+  //the slot we are looking at
+  uint32_t slot = hashToken(token, length) & mask;
+  //the token in the slot
+  uint32_t entry;
+  //probe until we hit an empty slot
+  while((entry = book -> index[slot]) != 0){
+    //compare the length first, then the bytes
+    entry--;
+    if(book -> offsets[entry+1] - book -> offsets[entry] == (uint32_t)length && memcmp(book -> pool + book -> offsets[entry], token, length) == 0){
+      return entry;
+    }
+    slot = (slot + 1) & mask;
+  }
+  //the token is not in the codebook
+  return -1;
+}
+
+/* hands the tokens of a binary codebook over to the decoder, they are in canonical order so the tables are built without sorting */
+int binaryDecoder(struct binaryCodebook * book){
+  //loop counter
+  uint32_t i;
+  //go through every token
+  for(i = 0; i < book -> header -> count; i++){
+    //the symbol points straight into the mapping, the code is the integer the codebook stores
+    if(decoderAddCode(book -> codes[i], book -> lengths[i], book -> pool + book -> offsets[i], book -> offsets[i+1] - book -> offsets[i])){
+      return 1;
+    }
+  }
+  //build the tables
+  return buildDecodeTables();
+}
+
+/* orders list positions by frequency and then by token */
+int weightCompare(const void * a, const void * b){
+  //the positions being compared
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  //rarer tokens go first
+  if(codeList -> weights[x] != codeList -> weights[y]){
+    return codeList -> weights[x] < codeList -> weights[y] ? -1 : 1;
+  }
+  //then sort by the token
+  return strcmp(codeList -> tokens[x], codeList -> tokens[y]);
+}
+
+/* if any code in the code list is longer than maxLength, recomputes every length with the package-merge
+algorithm which gives the best code lengths that stay within maxLength, returns 1 if the tokens can't fit */
+int limitCodeLengths(int maxLength){
+  //the number of tokens
+  int n = codeList -> count;
+  //positions of the list sorted by frequency
+  int * order;
+  //the weights of the items of the current and the previous level
+  long * items;
+  long * prevItems;
+  //for every level, whether each item of that level is a token (1) or a package (0)
+  char ** isLeaf;
+  //the number of items at every level
+  int * levelSize;
+  //the number of items we take from a level
+  int take;
+  //the number of tokens among them
+  int leaves;
+  //loop counters and merge positions
+  int i;
+  int level;
+  int leaf;
+  int pack;
+  //the longest code we have now
+  int longest = 0;
+  //temp for swapping the item arrays
+  long * temp;
+  //find the longest code
+  for(i = 0; i < n; i++){
+    if(codeList -> lengths[i] > longest){
+      longest = codeList -> lengths[i];
+    }
+  }
+  //nothing to do if the codes are short enough already
+  if(longest <= maxLength){
+    return 0;
+  }
+  //there are only 2^maxLength codes of maxLength bits
+  if(maxLength < 31 && n > (1 << maxLength)){
+    return 1;
+  }
+  //make space for everything
+  order = (int *)malloc(n*sizeof(int));
+  items = (long *)malloc(2*n*sizeof(long));
+  prevItems = (long *)malloc(2*n*sizeof(long));
+  isLeaf = (char **)malloc((maxLength+1)*sizeof(char *));
+  levelSize = (int *)malloc((maxLength+1)*sizeof(int));
+  if(!order || !items || !prevItems || !isLeaf || !levelSize){
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(0);
+  }
+  //sort the tokens from the rarest to the most common
+  for(i = 0; i < n; i++){
+    order[i] = i;
+    //every token starts with no bits
+    codeList -> lengths[i] = 0;
+  }
+  qsort(order, n, sizeof(int), weightCompare);
+  //the first level is just the tokens
+  for(i = 0; i < n; i++){
+    prevItems[i] = codeList -> weights[order[i]];
+  }
+  levelSize[1] = n;
+  isLeaf[1] = (char *)malloc(n);
+  if(!isLeaf[1]){
+    printf("FATAL ERROR: Not enough memory\n");
+    exit(0);
+  }
+  memset(isLeaf[1], 1, n);
+  //every other level merges the tokens with the packages (pairs) of the level before
+  for(level = 2; level <= maxLength; level++){
+    isLeaf[level] = (char *)malloc(n + levelSize[level-1]/2);
+    if(!isLeaf[level]){
+      printf("FATAL ERROR: Not enough memory\n");
+      exit(0);
+    }
+    //merge the tokens and the packages by weight, tokens first on ties
+    leaf = 0;
+    pack = 0;
+    levelSize[level] = 0;
+    while(leaf < n || pack < levelSize[level-1]/2){
+      if(pack >= levelSize[level-1]/2 || (leaf < n && codeList -> weights[order[leaf]] <= prevItems[2*pack] + prevItems[2*pack+1])){
+        items[levelSize[level]] = codeList -> weights[order[leaf++]];
+        isLeaf[level][levelSize[level]++] = 1;
+      } else{
+        items[levelSize[level]] = prevItems[2*pack] + prevItems[2*pack+1];
+        pack++;
+        isLeaf[level][levelSize[level]++] = 0;
+      }
+    }
+    //this level is the previous one for the next level
+    temp = prevItems;
+    prevItems = items;
+    items = temp;
+  }
+  //take the cheapest 2n-2 items of the last level and walk down the levels
+  take = 2*n - 2;
+  for(level = maxLength; level >= 1 && take > 0; level--){
+    //count the tokens among the items we take
+    leaves = 0;
+    for(i = 0; i < take; i++){
+      leaves += isLeaf[level][i];
+    }
+    //the tokens are the rarest ones, each of them gets one more bit
+    for(i = 0; i < leaves; i++){
+      codeList -> lengths[order[i]]++;
+    }
+    //every package we took is made of two items from the level below
+    take = 2*(take - leaves);
+  }
+  //a lone token still needs one bit
+  if(n == 1){
+    codeList -> lengths[0] = 1;
+  }
+  //free everything
+  for(level = 1; level <= maxLength; level++){
+    free(isLeaf[level]);
+  }
+  free(isLeaf);
+  free(levelSize);
+  free(items);
+  free(prevItems);
+  free(order);
+  //success!
+  return 0;
+}
+
+/* adds a token and its code length to the end of the list */
+int canonAdd(struct canonList * list, char * token, int length, long weight){
+  //temp for growing the arrays
+  void * temp;
+  //check if we need more space
+  if(list -> count >= list -> cap){
+    //double the capacity
+    list -> cap = list -> cap ? list -> cap*2 : 1024;
+    temp = realloc(list -> tokens, list -> cap*sizeof(char *));
+    if(!temp){
+      return 1;
+    }
+    list -> tokens = temp;
+    temp = realloc(list -> lengths, list -> cap*sizeof(int));
+    if(!temp){
+      return 1;
+    }
+    list -> lengths = temp;
+    temp = realloc(list -> weights, list -> cap*sizeof(long));
+    if(!temp){
+      return 1;
+    }
+    list -> weights = temp;
+  }
+  //add the entry
+  list -> tokens[list -> count] = token;
+  list -> lengths[list -> count] = length;
+  list -> weights[list -> count] = weight;
+  list -> count++;
+  //success!
+  return 0;
+}
+
+/* hands out canonical codes: shorter codes first, codes of the same length in list order,
+each code is the previous one plus one, shifted left to its length. Returns the codes as integers (the low length bits)
+or NULL if the lengths don't make a valid code */
+unsigned int * canonCodes(struct canonList * list){
+  //the codes we hand out
+  unsigned int * codes;
+  //the number of tokens of every length, then the next code of every length
+  unsigned long long perLength[MAX_CODE_LENGTH+1];
+  unsigned long long next[MAX_CODE_LENGTH+1];
+  //the first code of the current length
+  unsigned long long code = 0;
+  //loop counters
+  int i;
+  int len;
+  //count the tokens of every length, codes need at least one bit and have to fit in the integers
+  memset(perLength, 0x0, sizeof(perLength));
+  for(i = 0; i < list -> count; i++){
+    if(list -> lengths[i] < 1 || list -> lengths[i] > MAX_CODE_LENGTH){
+      return NULL;
+    }
+    perLength[list -> lengths[i]]++;
+  }
+  //the first code of every length follows the last code of the length before it
+  for(len = 1; len <= MAX_CODE_LENGTH; len++){
+    code <<= 1;
+    next[len] = code;
+    code += perLength[len];
+    //check if we ran out of codes
+    if(code > (1ULL << len)){
+      return NULL;
+    }
+  }
+  //hand out the codes in one pass over the list
+  codes = (unsigned int *)malloc((list -> count+1)*sizeof(unsigned int));
+  if(!codes){
+    return NULL;
+  }
+  for(i = 0; i < list -> count; i++){
+    codes[i] = next[list -> lengths[i]]++;
+  }
+  //we're done
+  return codes;
+}
+
+/* writes the code out as a string of '0' and '1' characters kept in the arena */
+char * codeString(struct arena * strings, unsigned int code, int length){
+  //the code as a string
+  char bits[MAX_CODE_LENGTH+1];
+  //loop counter
+  int bit;
+  for(bit = 0; bit < length; bit++){
+    bits[bit] = ((code >> (length - 1 - bit)) & 1) ? '1' : '0';
+  }
+  return arenaString(strings, bits, length);
+}
+
+/* orders list positions by code length and then by token */
+int canonCompare(const void * a, const void * b){
+  //the positions being compared
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  //shorter codes go first
+  if(codeList -> lengths[x] != codeList -> lengths[y]){
+    return codeList -> lengths[x] - codeList -> lengths[y];
+  }
+  //then sort by the token
+  return strcmp(codeList -> tokens[x], codeList -> tokens[y]);
+}
+
+/* sorts the code list, hands out canonical codes and writes either the codes or just the lengths to the codebook */
+int writeCodebook(int fd, int canonical, int binary){
+  //positions of the list in sorted order
+  int * order;
+  //the sorted list
+  struct canonList sorted;
+  //the codes of the sorted list
+  unsigned int * codes;
+  //text codebooks go out through one big buffer
+  struct byteWriter writer;
+  //one line of the codebook up to the token, the code or length and the tab
+  char line[MAX_CODE_LENGTH+2];
+  int lineLen;
+  //whether a write failed
+  int failed = 0;
+  //loop counters
+  int i;
+  int bit;
+  //sort the positions
+  order = (int *)malloc(codeList -> count*sizeof(int) + 1);
+  if(!order){
+    return 1;
+  }
+  for(i = 0; i < codeList -> count; i++){
+    order[i] = i;
+  }
+  qsort(order, codeList -> count, sizeof(int), canonCompare);
+  //copy the list over in sorted order
+  memset(&sorted, 0x0, sizeof(struct canonList));
+  for(i = 0; i < codeList -> count; i++){
+    if(canonAdd(&sorted, codeList -> tokens[order[i]], codeList -> lengths[order[i]], codeList -> weights[order[i]])){
+      return 1;
+    }
+  }
+  //hand out the codes
+  codes = canonCodes(&sorted);
+  if(!codes){
+    return 1;
+  }
+  //binary codebooks are written in one go
+  if(binary){
+    failed = writeBinaryCodebook(fd, &sorted, codes);
+  } else{
+    //the writer appends to the codebook
+    writer.fd = fd;
+    writer.buff = (char *)malloc(IO_BUFFER_SIZE);
+    writer.used = 0;
+    writer.offset = -1;
+    if(!writer.buff){
+      return 1;
+    }
+    //write the escape character being used, canonical codebooks say so on the same line
+    failed = canonical ? byteWriterPut(&writer, "$\tcanonical\n", 12) : byteWriterPut(&writer, "$\n", 2);
+    //write every token
+    for(i = 0; i < sorted.count && !failed; i++){
+      //canonical codebooks only need the length
+      if(canonical){
+        lineLen = sprintf(line, "%d", sorted.lengths[i]);
+      } else{
+        for(bit = 0; bit < sorted.lengths[i]; bit++){
+          line[bit] = ((codes[i] >> (sorted.lengths[i] - 1 - bit)) & 1) ? '1' : '0';
+        }
+        lineLen = bit;
+      }
+      line[lineLen++] = '\t';
+      failed = byteWriterPut(&writer, line, lineLen) || byteWriterPut(&writer, sorted.tokens[i], strlen(sorted.tokens[i])) || byteWriterPut(&writer, "\n", 1);
+    }
+    //write out whatever is left
+    failed = failed || byteWriterFlush(&writer);
+    free(writer.buff);
+  }
+  //free everything
+  free(codes);
+  free(order);
+  free(sorted.tokens);
+  free(sorted.lengths);
+  free(sorted.weights);
+  return failed;
+}
+
+/* given a directory stream, traverses the directory/files and stores in the files array */
+int direcTraverse (DIR *myDirectory, int counter, int currSize, char * currDirec){
+  //stores the filepath of our subdirectories
+  char filePBuff[PATH_MAX + 1];
+  //in the case of recursion, update the filepath so that we do not get lost
+  strcpy(filePBuff, currDirec);
+  //add a forward-slash at the end to get ready to add more to the path
+  strcat(filePBuff, "/");
+  //the dirent struct which holds whatever readdir returns
+  struct dirent *currDir;
+  //loop through the contents of the directory and store in files array
+  while((currDir = readdir(myDirectory)) != NULL){
+    //skip the . and .. and dsstore file
+    if(strcmp(currDir->d_name, ".") == 0 || strcmp(currDir->d_name, "..") == 0 || strcmp(currDir->d_name,".DS_Store") == 0){
+      //skip the iteration
+      continue;
+    }
+    //first check if the currdir is a regular file or a directory
+    if(currDir->d_type == DT_DIR){
+      //add the directory in question to the path
+      strcat(filePBuff, currDir->d_name);
+      //traverse the new directory
+      counter = direcTraverse(opendir(filePBuff), counter, currSize, filePBuff);
+      //we are back in the original file, get rid of the previous file path
+      strcpy(filePBuff, currDirec);
+      //put the forward-slash back in there
+      strcat(filePBuff, "/");
+      //find the new max size of the array
+      currSize = ((counter%100)+1)*100;
+    } else if(currDir -> d_type == DT_REG){
+      //allocate space for the file path
+      files[counter] = (char *)malloc((PATH_MAX+1) * sizeof(char));
+      //add the file path to the array
+      strcpy(files[counter],filePBuff);
+      //store the names of the files in our files array
+      strcat(files[counter], currDir->d_name);
+      //just to test the code
+      //printf("%s\n", files[counter]);
+      //check if files array needs more space
+      if(++counter >= currSize){
+        //realloc 100 more spaces in our files array
+        files = realloc(files, (currSize+100) * sizeof(char *));
+        //check is the given file exists
+        if(!files){
+          //file does not exist it is a fatal error
+          printf("FATAL ERROR: Not enough memory\n");
+          //exit the code
+          exit(1);
         }
-      } else{
-        //continue filling up cdata
-        cdata[localcount] = buff[counter];
+        //change the curr size accordingly
+        currSize += 100;
       }
-    } else if(!indicator){ // we are dealing with the bitcode
-    	if(localcount >= bSize) {
-    		//temporarily relocate the existing numbers
-    		temp = bdata;
-        //allocate more space for the bitcode
-    		bdata = (char*)malloc((bSize+10)*sizeof(char));
-        //checks make sure there is space
-    		if(bdata == NULL) {
-          //there's no space
-    			printf("ERROR: Not enough space on heap\n");
-          //unsuccessful
-          return 1;
-    		}
-        //increase the space used by our token
-        bSize += 10;
-        //set the token to null terminators
-    		memset(bdata, '\0', bSize);
-        //copy the temp stuff back into our cdata
-    		memcpy(bdata, temp, localcount);
-        //TODO: remember to free temp in the decompress tokenizer
-    		free(temp);
-    	}
-      //continue reading the bitcode
-      bdata[localcount] = buff[counter];
-	  }
-  //increment counters
-  counter++;
-  localcount++;
+    }
+  }
+  //return the current count
+  return counter;
+}
+
+/* turns the counted vocabulary into the code lengths, writes them to HuffmanCodebook and frees the vocabulary */
+void writeBuild(int canonical, int binary, int maxCodeLength, int topK, long minFreq){
+  //the codebook file, only created once the code lengths are final so a failed build leaves the old one alone
+  int codFD;
+  //assign the value of the escape sequence
+  escapeSequence = "$\0";
+  //make space for the list of tokens and their code lengths
+  codeList = (struct canonList *)malloc(sizeof(struct canonList));
+  if(!codeList){
+    //no space
+    printf("FATAL ERROR: Not enough memory\n");
+    //exit the code
+    exit(1);
+  }
+  //the list starts out empty
+  memset(codeList, 0x0, sizeof(struct canonList));
+  //calculate the code length of every token we keep, the rest go through the escape code
+  if(huffmanLengths(topK, minFreq)){
+    //no space
+    printf("FATAL ERROR: Not enough memory\n");
+    //exit the code
+    exit(1);
+  }
+  //make sure no code is longer than we allow
+  if(limitCodeLengths(maxCodeLength)){
+    //there are too many tokens for codes this short
+    printf("FATAL ERROR: %d tokens do not fit in codes of at most %d bits\n", codeList -> count, maxCodeLength);
+    //exit
+    exit(1);
+  }
+  //the code lengths are final, now we can create the codebook file
+  codFD = open("HuffmanCodebook", O_TRUNC | O_RDWR | O_CREAT,  S_IRUSR | S_IWUSR);
+  //creating the file is unsuccessfull
+  if(codFD < 0){
+    //unable to open the codebook for whatever reason
+    printf("FATAL ERROR: Unable to open the huffman codebook file\n");
+    //exit
+    exit(1);
+  }
+  //hand out canonical codes and write them to the codebook
+  if(writeCodebook(codFD, canonical, binary)){
+    //we could not write the codebook
+    printf("FATAL ERROR: Unable to write the huffman codebook\n");
+    //exit
+    exit(1);
+  }
+  //close the file descriptor once we're done writing
+  close(codFD);
+  //the vocabulary isn't needed anymore, every token lives in the pool
+  mapFree(&vocab.table);
+  arenaFree(&vocab.arena);
+  if(runTokens){
+    munmap(runTokens, runTokensSize);
+    runTokens = NULL;
+  }
+}
+
+/* free the files array */
+void freeFiles(int numberOfFiles){
+  //counter
+  int i;
+  //no need to loop is there is only one file
+  if(numberOfFiles > 1){
+    //loop through the files array and free em all
+    for(i = 0; i < numberOfFiles; i++){
+      //free file at i
+      free(files[i]);
+    }
+  }
+  //free the files array itself
+  free(files);
+}
+
+
+/* iterates through the files and first calls file reader on each file, with more than one thread
+every thread counts its share of the files on its own and the counts are merged at the end */
+int buildCodebook (int filesSize, int threads){
+  //random local variables
+  int counter;
+  //the files the threads share
+  struct buildJob job;
+  //the threads
+  struct buildWorker * workers;
+  //there's no point in more threads than files
+  if(threads > filesSize){
+    threads = filesSize;
+  }
+  //the sketch is already bounded, there's nothing to spill
+  if(sketchBudget > 0 && spillBudget > 0){
+    printf("ERROR: -m and -s can't be used together\n");
+    return 1;
+  }
+  //with a spill budget every thread gets an equal share of it
+  vocab.budget = spillBudget > 0 && spillBudget < MIN_SPILL_BUDGET ? MIN_SPILL_BUDGET : spillBudget;
+  //with a memory budget every thread and the merged counts each get an equal share of it
+  if(sketchBudget > 0 && sketchInit(&vocab, threads <= 1 ? sketchBudget : sketchBudget/(threads+1))){
+    printf("FATAL ERROR: The memory budget is too small\n");
+    return 1;
+  }
+  //one thread counts straight into the vocabulary
+  if(threads <= 1){
+    //loop through the files array
+    for(counter = 0; counter < filesSize; counter++){
+      //open the file at the specific index to a read only mode
+      int fd = open(files[counter], O_RDONLY);
+      //check is the given file exists
+      if(fd < 0){
+        //file does not exist it is a fatal error
+        printf("FATAL ERROR: File does not exist\n");
+        //exit the code
+        exit(1);
+      }
+      //hand the fd over to the build frequencies method to update our hash table
+      fileReader(fd, &vocab);
+      //close the file descriptor once you are done with it
+      close(fd);
+    }
+    //with a spill budget the rest of the counts are a run of their own, the merge puts them all back together
+    if(vocab.budget > 0 && spillRun(&vocab)){
+      return 1;
+    }
+    //the huffman construction works on the table
+    return sketchUnload(&vocab);
+  }
+  //the threads start at the first file
+  job.filesSize = filesSize;
+  job.next = 0;
+  pthread_mutex_init(&job.lock, NULL);
+  //make space for the threads
+  workers = (struct buildWorker *)calloc(threads, sizeof(struct buildWorker));
+  if(!workers){
+    printf("FATAL ERROR: Not enough memory\n");
+    return 1;
+  }
+  //start every thread with an empty vocabulary of its own
+  for(counter = 0; counter < threads; counter++){
+    workers[counter].job = &job;
+    workers[counter].vocab.budget = spillBudget > 0 && spillBudget/threads < MIN_SPILL_BUDGET ? MIN_SPILL_BUDGET : spillBudget/threads;
+    if(mapInit(&workers[counter].vocab.table, 1024) || (vocab.sketch && sketchInit(&workers[counter].vocab, sketchBudget/(threads+1)))
+        || pthread_create(&workers[counter].thread, NULL, buildThread, &workers[counter])){
+      printf("FATAL ERROR: Unable to start a build thread\n");
+      exit(1);
+    }
+  }
+  //wait for every thread and fold its counts into ours, in thread order
+  for(counter = 0; counter < threads; counter++){
+    pthread_join(workers[counter].thread, NULL);
+    //with a spill budget the thread's counts become a run instead, so they never all have to be in memory at once
+    if(spillBudget > 0 ? spillRun(&workers[counter].vocab) : vocabMerge(&vocab, &workers[counter].vocab)){
+      printf("FATAL ERROR: Not enough memory\n");
+      return 1;
+    }
+    //the thread's vocabulary has been copied over
+    mapFree(&workers[counter].vocab.table);
+    arenaFree(&workers[counter].vocab.arena);
+    sketchFree(workers[counter].vocab.sketch);
+  }
+  //clean up
+  pthread_mutex_destroy(&job.lock);
+  free(workers);
+  //the huffman construction works on the table
+  return sketchUnload(&vocab);
+}
+
+/* a build thread keeps taking the next file and counting it into its own vocabulary until there are none left */
+void * buildThread(void * arg){
+  //the thread's state
+  struct buildWorker * worker = (struct buildWorker *)arg;
+  //the file to count
+  int index;
+  int fd;
+  while(1){
+    //take the next file
+    pthread_mutex_lock(&worker -> job -> lock);
+    index = worker -> job -> next++;
+    pthread_mutex_unlock(&worker -> job -> lock);
+    //check if we're done
+    if(index >= worker -> job -> filesSize){
+      return NULL;
+    }
+    //open the file at the specific index to a read only mode
+    fd = open(files[index], O_RDONLY);
+    //check is the given file exists
+    if(fd < 0){
+      //file does not exist it is a fatal error
+      printf("FATAL ERROR: File does not exist\n");
+      //exit the code
+      exit(1);
+    }
+    //count the file
+    fileReader(fd, &worker -> vocab);
+    //close the file descriptor once you are done with it
+    close(fd);
+  }
+}
+
+/* adds the counts of every token in from to into, copying the tokens into's pool has not seen */
+int vocabMerge(struct vocabulary * into, struct vocabulary * from){
+  //loop counter
+  int i;
+  //the slot of the token in into
+  struct tableEntry * entry;
+  //whether into already had the token
+  int found;
+  //sketches are merged counter by counter, the weighted counts stay within the error of both
+  if(from -> sketch){
+    for(i = 0; i < from -> sketch -> used; i++){
+      if(sketchAdd(into -> sketch, from -> sketch -> counters[i].key, from -> sketch -> counters[i].keyLen, from -> sketch -> counters[i].count, from -> sketch -> counters[i].error)){
+        return 1;
+      }
+    }
+    return 0;
+  }
+  for(i = 0; i < from -> table.cap; i++){
+    //skip empty slots
+    if(!from -> table.slots[i].key){
+      continue;
+    }
+    //find or make the token's slot
+    entry = mapInsert(&into -> table, from -> table.slots[i].key, from -> table.slots[i].keyLen, &found);
+    if(!entry){
+      return 1;
+    }
+    //new tokens need a copy that outlives from
+    if(!found){
+      entry -> key = arenaString(&into -> arena, from -> table.slots[i].key, from -> table.slots[i].keyLen);
+      if(!(entry -> key)){
+        return 1;
+      }
+    }
+    //add the counts up
+    entry -> value += from -> table.slots[i].value;
   }
   return 0;
 }
 
-/* this method will take the token and bitcode of the token and make a node for it and insert it into the hashtable */
-int hInsert (char * name, char * bitname) {
-  //store the hashcode
-	int sum = 0;
-  //loop counter declaration
+/* adds the counts saved in every input frequency file to the vocabulary, then saves the result to output if there is one.
+With a spill budget the spilled runs and the inputs are merged on disk instead */
+int mergeFrequencies(char ** inputs, int numInputs, char * output, int topK, long minFreq){
+  //loop counter
   int i;
-  //store the newnode
-  struct huffNode * newNode;
-  //for LL traversal
-  struct huffNode * temp;
-  //calculate the hashcode
-	for (i = 0; i < strlen(name); i++){
-    sum += (int)name[i];
-	}
-  //calculate the index by modding the hashcode
-	int index = sum % 256;
-  //check if the index is negative and make it positive
-  if(index < 0){
-    index *= -1;
-  }
-  //check if the hashtable at said index is empty
-	if(huffmanTable[index] == NULL) {
-    //TODO: edit my initial hashtable method to reflect the changes create a new node and put er in there
-    newNode = (struct huffNode *)malloc(sizeof(struct huffNode));
-    //memory error
-    if(!newNode){
-      //no space
-      printf("FATAL ERROR: Not enough space on the heap");
-      //return unsuccessful
+  if(spillBudget > 0){
+    return mergeRuns(inputs, numInputs, output, topK, minFreq);
+  }
+  for(i = 0; i < numInputs; i++){
+    if(readFrequencies(inputs[i])){
+      printf("ERROR: %s is not a valid frequency file\n", inputs[i]);
       return 1;
     }
-    //populate the node's values
-    newNode -> token = name;
-    newNode -> bittok = bitname;
-    newNode -> next = NULL;
-    //now assign the head of the particular index to the huffman table
-    huffmanTable[index] = newNode;
-    //we finished the insertion
+  }
+  //save the counts for the next build
+  if(output && writeFrequencies(output)){
+    printf("ERROR: Unable to write the frequency file %s\n", output);
+    return 1;
+  }
+  return 0;
+}
+
+/* maps a frequency file and adds every count in it to the vocabulary */
+int readFrequencies(char * path){
+  //the file and its size
+  int fd = open(path, O_RDONLY);
+  struct stat fileStat;
+  //the mapped file, its header and the record we're on
+  char * map;
+  struct frequencyHeader header;
+  size_t pos;
+  //the length and count of the record
+  uint32_t keyLen;
+  uint64_t count;
+  //the slot of the token and whether it was already there
+  struct tableEntry * entry;
+  int found;
+  //whether the file made sense
+  int failed = 0;
+  //loop counter
+  uint32_t i;
+  if(fd < 0){
+    return 1;
+  }
+  if(fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size < sizeof(struct frequencyHeader)){
+    close(fd);
+    return 1;
+  }
+  //map the whole file, the records are read straight out of it
+  map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED){
+    return 1;
+  }
+  madvise(map, fileStat.st_size, MADV_SEQUENTIAL);
+  //check the header
+  memcpy(&header, map, sizeof(struct frequencyHeader));
+  if(memcmp(header.magic, HCF_MAGIC, 4) != 0){
+    munmap(map, fileStat.st_size);
+    return 1;
+  }
+  //go through every record
+  pos = sizeof(struct frequencyHeader);
+  for(i = 0; i < header.count && !failed; i++){
+    //make sure the record is all there
+    if(pos + HCF_RECORD_SIZE > (size_t)fileStat.st_size){
+      failed = 1;
+      break;
+    }
+    memcpy(&keyLen, map + pos, 4);
+    memcpy(&count, map + pos + 4, 8);
+    pos += HCF_RECORD_SIZE;
+    if(keyLen == 0 || keyLen > INT_MAX || pos + keyLen > (size_t)fileStat.st_size){
+      failed = 1;
+      break;
+    }
+    //find or make the token's slot
+    entry = mapInsert(&vocab.table, map + pos, keyLen, &found);
+    if(!entry){
+      failed = 1;
+      break;
+    }
+    //new tokens need a copy that outlives the mapping
+    if(!found){
+      entry -> key = arenaString(&vocab.arena, map + pos, keyLen);
+      failed = !(entry -> key);
+    }
+    //add the counts up
+    entry -> value += count;
+    pos += keyLen;
+  }
+  munmap(map, fileStat.st_size);
+  return failed;
+}
+
+/* saves the count of every token in the vocabulary to a frequency file */
+int writeFrequencies(char * path){
+  //the file
+  int fd = open(path, O_TRUNC | O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+  //whether a write failed
+  int failed;
+  if(fd < 0){
+    return 1;
+  }
+  failed = writeRun(fd, &vocab);
+  close(fd);
+  return failed;
+}
+
+/* writes the counts of the table to the file sorted by token, so every frequency file is also a run the merge can read */
+int writeRun(int fd, struct vocabulary * counts){
+  //the writer buffering the file
+  struct byteWriter writer;
+  //the header and the start of every record
+  struct frequencyHeader header;
+  char record[HCF_RECORD_SIZE];
+  uint32_t keyLen;
+  uint64_t count;
+  //the slots of the tokens in order
+  struct tableEntry ** sorted;
+  //whether a write failed
+  int failed;
+  //loop counters
+  int i;
+  int n = 0;
+  //sort the tokens
+  sorted = (struct tableEntry **)malloc((counts -> table.used+1)*sizeof(struct tableEntry *));
+  if(!sorted){
+    return 1;
+  }
+  for(i = 0; i < counts -> table.cap; i++){
+    if(counts -> table.slots[i].key){
+      sorted[n++] = &counts -> table.slots[i];
+    }
+  }
+  qsort(sorted, n, sizeof(struct tableEntry *), runCompare);
+  writer.fd = fd;
+  writer.buff = (char *)malloc(IO_BUFFER_SIZE);
+  writer.used = 0;
+  writer.offset = -1;
+  if(!writer.buff){
+    free(sorted);
+    return 1;
+  }
+  //the header
+  memcpy(header.magic, HCF_MAGIC, 4);
+  header.count = n;
+  failed = byteWriterPut(&writer, (char *)&header, sizeof(struct frequencyHeader));
+  //every token in order
+  for(i = 0; i < n && !failed; i++){
+    keyLen = sorted[i] -> keyLen;
+    count = sorted[i] -> value;
+    memcpy(record, &keyLen, 4);
+    memcpy(record + 4, &count, 8);
+    failed = byteWriterPut(&writer, record, HCF_RECORD_SIZE) || byteWriterPut(&writer, sorted[i] -> key, keyLen);
+  }
+  //write out whatever is left
+  failed = failed || byteWriterFlush(&writer);
+  free(writer.buff);
+  free(sorted);
+  return failed;
+}
+
+/* orders tokens by their bytes, a token comes before the longer tokens it starts */
+int keyOrder(const char * a, int aLen, const char * b, int bLen){
+  int order = memcmp(a, b, aLen < bLen ? aLen : bLen);
+  return order ? order : aLen - bLen;
+}
+
+/* orders table slots by their token */
+int runCompare(const void * a, const void * b){
+  const struct tableEntry * x = *(struct tableEntry * const *)a;
+  const struct tableEntry * y = *(struct tableEntry * const *)b;
+  return keyOrder(x -> key, x -> keyLen, y -> key, y -> keyLen);
+}
+
+/* makes a new empty file for a run in the temp directory, returns its descriptor (-1 on failure) and sets path to its name */
+int tempRun(char ** path){
+  //where the runs go
+  char * dir = getenv("TMPDIR");
+  //the file
+  int fd;
+  if(!dir || !*dir){
+    dir = "/tmp";
+  }
+  *path = (char *)malloc(strlen(dir) + 16);
+  if(!*path){
+    return -1;
+  }
+  sprintf(*path, "%s/hczrunXXXXXX", dir);
+  fd = mkstemp(*path);
+  if(fd < 0){
+    free(*path);
+    *path = NULL;
+  }
+  return fd;
+}
+
+/* writes the table to a new sorted run in the temp directory and starts the vocabulary over empty */
+int spillRun(struct vocabulary * counts){
+  //the run and its file
+  char * path;
+  int fd;
+  //temp for growing the run list
+  char ** temp;
+  //nothing to spill
+  if(counts -> table.used == 0){
     return 0;
-	} else {
-    //we need to traverse a linkedlist TODO: Also edit my initial hashtable method
-		temp = huffmanTable[index];
-    //make newNode the new head of the linked list at the index
-		newNode = (struct huffNode *)malloc(sizeof(struct huffNode));
-    //memory error
-    if(!newNode){
-      //no space
-      printf("FATAL ERROR: Not enough space on the heap");
-      //return unsuccessful
+  }
+  fd = tempRun(&path);
+  if(fd < 0){
+    return 1;
+  }
+  if(writeRun(fd, counts)){
+    close(fd);
+    unlink(path);
+    free(path);
+    return 1;
+  }
+  close(fd);
+  //remember the run, the build threads spill at the same time
+  pthread_mutex_lock(&spillLock);
+  if(numSpillRuns == spillRunCap){
+    spillRunCap = spillRunCap ? spillRunCap*2 : 16;
+    temp = (char **)realloc(spillRuns, spillRunCap*sizeof(char *));
+    if(!temp){
+      pthread_mutex_unlock(&spillLock);
       return 1;
     }
-    //populate
-    newNode -> token = name;
-    newNode -> bittok = bitname;
-		newNode->next = temp;
-    //make newnode the new head
-    huffmanTable[index] = newNode;
-	}
-  //success!
+    spillRuns = temp;
+  }
+  spillRuns[numSpillRuns++] = path;
+  pthread_mutex_unlock(&spillLock);
+  //start over with an empty table and arena
+  mapFree(&counts -> table);
+  arenaFree(&counts -> arena);
+  return mapInit(&counts -> table, 1024);
+}
+
+/* maps a run and reads its first record */
+int runOpen(struct runReader * run, char * path){
+  //the file and its size
+  int fd = open(path, O_RDONLY);
+  struct stat fileStat;
+  //the header of the run
+  struct frequencyHeader header;
+  memset(run, 0x0, sizeof(struct runReader));
+  if(fd < 0){
+    return 1;
+  }
+  if(fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size < sizeof(struct frequencyHeader)){
+    close(fd);
+    return 1;
+  }
+  //the records are read straight out of the mapping
+  run -> size = fileStat.st_size;
+  run -> map = mmap(NULL, run -> size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(run -> map == MAP_FAILED){
+    run -> map = NULL;
+    return 1;
+  }
+  madvise(run -> map, run -> size, MADV_SEQUENTIAL);
+  memcpy(&header, run -> map, sizeof(struct frequencyHeader));
+  if(memcmp(header.magic, HCF_MAGIC, 4) != 0){
+    return 1;
+  }
+  run -> pos = sizeof(struct frequencyHeader);
+  run -> left = header.count;
+  //load the first record
+  return runNext(run) < 0;
+}
+
+/* moves the run to its next record, returns 1 if there is one, 0 at the end and -1 if the run is broken or out of order */
+int runNext(struct runReader * run){
+  //the token before this one
+  char * lastKey = run -> key;
+  uint32_t lastLen = run -> keyLen;
+  if(run -> left == 0){
+    return 0;
+  }
+  run -> left--;
+  //make sure the record is all there
+  if(run -> pos + HCF_RECORD_SIZE > run -> size){
+    return -1;
+  }
+  memcpy(&run -> keyLen, run -> map + run -> pos, 4);
+  memcpy(&run -> count, run -> map + run -> pos + 4, 8);
+  run -> pos += HCF_RECORD_SIZE;
+  if(run -> keyLen == 0 || run -> keyLen > INT_MAX || run -> pos + run -> keyLen > run -> size){
+    return -1;
+  }
+  run -> key = run -> map + run -> pos;
+  run -> pos += run -> keyLen;
+  //every token has to come after the one before it
+  if(lastKey && keyOrder(lastKey, lastLen, run -> key, run -> keyLen) >= 0){
+    return -1;
+  }
+  return 1;
+}
+
+/* moves the run at heap position pos down until the heap of runs is ordered by their current tokens again */
+void runSift(struct runReader * runs, int * heap, int n, int pos){
+  //the run being moved and the smaller child
+  int r = heap[pos];
+  int child;
+  while(2*pos+1 < n){
+    child = 2*pos+1;
+    if(child+1 < n && keyOrder(runs[heap[child+1]].key, runs[heap[child+1]].keyLen, runs[heap[child]].key, runs[heap[child]].keyLen) < 0){
+      child++;
+    }
+    if(keyOrder(runs[heap[child]].key, runs[heap[child]].keyLen, runs[r].key, runs[r].keyLen) >= 0){
+      break;
+    }
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  heap[pos] = r;
+}
+
+/* merges the spilled runs and the input frequency files into one sorted run (saved to output if there is one) and reads
+the tokens the codebook could use back out of it as flat leaves, their bytes go to a mapped token file instead of the vocabulary.
+Only tokens that could be among the topK most frequent and are seen at least minFreq times become leaves, the rest go straight to
+the escape code */
+int mergeRuns(char ** inputs, int numInputs, char * output, int topK, long minFreq){
+  //every run and a min heap of the ones that have records left
+  int numRuns = numSpillRuns + numInputs;
+  struct runReader * runs = (struct runReader *)calloc(numRuns+1, sizeof(struct runReader));
+  int * heap = (int *)malloc((numRuns+1)*sizeof(int));
+  int heapSize = 0;
+  //the biggest topK counts so far, a min heap that only grows as far as there are tokens
+  uint64_t * top = NULL;
+  int topSize = 0;
+  int topCap = 0;
+  uint64_t * temp;
+  //the merged run is written to a temp file first, the output may be one of the inputs
+  char * mergedPath = NULL;
+  int fd = -1;
+  struct byteWriter writer;
+  char record[HCF_RECORD_SIZE];
+  struct frequencyHeader header;
+  struct runReader merged;
+  //the token being merged and its total count
+  char * key;
+  uint32_t keyLen;
+  uint64_t count;
+  //the smallest count we keep and the counts we don't
+  uint64_t threshold = minFreq > 0 ? minFreq : 0;
+  long dropped = 0;
+  //the token file and the room for leaves
+  char * tokenPath = NULL;
+  int tokenFD = -1;
+  size_t tokenSize = 0;
+  int leafCap = 0;
+  struct leaf * grown;
+  //whether anything went wrong
+  int failed = 0;
+  int status;
+  //loop counters
+  int i;
+  int j;
+  memset(&merged, 0x0, sizeof(struct runReader));
+  //the counting is over, only the escape code goes into the vocabulary from here on
+  vocab.budget = 0;
+  //without a cut every distinct token ends up as a leaf
+  if(topK == 0 && minFreq <= 1){
+    printf("WARNING: -s without -k or -f keeps every token, building the codes still takes memory for each of them\n");
+  }
+  if(!runs || !heap){
+    return 1;
+  }
+  //open every run, the spilled ones are removed as soon as they are mapped
+  for(i = 0; i < numRuns && !failed; i++){
+    if(runOpen(&runs[i], i < numSpillRuns ? spillRuns[i] : inputs[i - numSpillRuns])){
+      printf("ERROR: %s is not a valid sorted frequency file\n", i < numSpillRuns ? spillRuns[i] : inputs[i - numSpillRuns]);
+      failed = 1;
+    } else if(runs[i].key){
+      heap[heapSize++] = i;
+    }
+  }
+  for(i = 0; i < numSpillRuns; i++){
+    unlink(spillRuns[i]);
+    free(spillRuns[i]);
+  }
+  free(spillRuns);
+  spillRuns = NULL;
+  numSpillRuns = 0;
+  spillRunCap = 0;
+  //the merged run goes next to the output so it can be renamed over it, or to the temp directory if nobody wants it
+  if(!failed && output){
+    mergedPath = (char *)malloc(strlen(output) + 8);
+    if(mergedPath){
+      sprintf(mergedPath, "%s.XXXXXX", output);
+      fd = mkstemp(mergedPath);
+    }
+  } else if(!failed){
+    fd = tempRun(&mergedPath);
+  }
+  writer.buff = (char *)malloc(IO_BUFFER_SIZE);
+  if(failed || !mergedPath || fd < 0 || !writer.buff){
+    failed = 1;
+  } else{
+    writer.fd = fd;
+    writer.used = 0;
+    writer.offset = -1;
+    //the count of the header is patched once we know it
+    memcpy(header.magic, HCF_MAGIC, 4);
+    header.count = 0;
+    failed = byteWriterPut(&writer, (char *)&header, sizeof(struct frequencyHeader));
+  }
+  //build the heap of runs
+  for(i = heapSize/2 - 1; i >= 0; i--){
+    runSift(runs, heap, heapSize, i);
+  }
+  //take the smallest token each time and add up its counts in every run that has it
+  while(heapSize > 0 && !failed){
+    key = runs[heap[0]].key;
+    keyLen = runs[heap[0]].keyLen;
+    count = 0;
+    while(heapSize > 0 && keyOrder(runs[heap[0]].key, runs[heap[0]].keyLen, key, keyLen) == 0){
+      count += runs[heap[0]].count;
+      status = runNext(&runs[heap[0]]);
+      if(status < 0){
+        printf("ERROR: A frequency file is broken or not sorted\n");
+        failed = 1;
+        break;
+      } else if(status == 0){
+        heap[0] = heap[--heapSize];
+      }
+      runSift(runs, heap, heapSize, 0);
+    }
+    //write the merged token
+    memcpy(record, &keyLen, 4);
+    memcpy(record + 4, &count, 8);
+    failed = failed || byteWriterPut(&writer, record, HCF_RECORD_SIZE) || byteWriterPut(&writer, key, keyLen);
+    header.count++;
+    //keep track of the topK biggest counts
+    if(topK > 0 && (topSize < topK || count > top[0])){
+      //make room for one more count
+      if(topSize == topCap && topSize < topK){
+        topCap = topCap ? (topCap > topK/2 ? topK : topCap*2) : (topK < 1024 ? topK : 1024);
+        temp = (uint64_t *)realloc(top, topCap*sizeof(uint64_t));
+        if(!temp){
+          failed = 1;
+          break;
+        }
+        top = temp;
+      }
+      //a new count goes at the end and moves up, a bigger one replaces the smallest and moves down
+      if(topSize < topK){
+        for(j = topSize++; j > 0 && top[(j-1)/2] > count; j = (j-1)/2){
+          top[j] = top[(j-1)/2];
+        }
+        top[j] = count;
+      } else{
+        for(j = 0; 2*j+1 < topSize; ){
+          i = 2*j+1;
+          if(i+1 < topSize && top[i+1] < top[i]){
+            i++;
+          }
+          if(top[i] >= count){
+            break;
+          }
+          top[j] = top[i];
+          j = i;
+        }
+        top[j] = count;
+      }
+    }
+  }
+  //finish the merged run
+  if(!failed){
+    failed = byteWriterFlush(&writer) || pwrite(fd, &header, sizeof(struct frequencyHeader), 0) != sizeof(struct frequencyHeader);
+  }
+  if(fd >= 0){
+    close(fd);
+  }
+  free(writer.buff);
+  for(i = 0; i < numRuns; i++){
+    if(runs[i].map){
+      munmap(runs[i].map, runs[i].size);
+    }
+  }
+  free(runs);
+  free(heap);
+  //every input is unmapped, so the merged run can take the output's place
+  if(output && mergedPath){
+    if(!failed && rename(mergedPath, output) < 0){
+      failed = 1;
+    }
+    if(failed){
+      unlink(mergedPath);
+    }
+    free(mergedPath);
+    mergedPath = failed ? NULL : output;
+  }
+  //a token with a smaller count than the topK biggest can never be kept
+  if(topK > 0 && topSize == topK && top[0] > threshold){
+    threshold = top[0];
+  }
+  free(top);
+  //the tokens the build could keep become leaves, the rest go to the escape code
+  if(!failed && !(failed = runOpen(&merged, mergedPath))){
+    writer.buff = (char *)malloc(IO_BUFFER_SIZE);
+    tokenFD = tempRun(&tokenPath);
+    failed = !writer.buff || tokenFD < 0;
+    writer.fd = tokenFD;
+    writer.used = 0;
+    writer.offset = -1;
+    for(status = merged.key ? 1 : 0; status > 0 && !failed; status = runNext(&merged)){
+      //the escape code is counted in the vocabulary
+      if(merged.count < threshold || keyOrder(merged.key, merged.keyLen, "$e", 2) == 0){
+        dropped += merged.count;
+        continue;
+      }
+      //make room for one more leaf
+      if(numRunLeaves == leafCap){
+        leafCap = leafCap ? leafCap*2 : 1024;
+        grown = (struct leaf *)realloc(runLeaves, leafCap*sizeof(struct leaf));
+        if(!grown){
+          failed = 1;
+          break;
+        }
+        runLeaves = grown;
+      }
+      //the key holds the offset of the token in the token file until the file is mapped
+      runLeaves[numRunLeaves].value = merged.count;
+      runLeaves[numRunLeaves].hash = hashToken(merged.key, merged.keyLen);
+      runLeaves[numRunLeaves].key = (char *)tokenSize;
+      numRunLeaves++;
+      //the tokens are null terminated like the ones in the vocabulary
+      failed = byteWriterPut(&writer, merged.key, merged.keyLen) || byteWriterPut(&writer, "", 1);
+      tokenSize += merged.keyLen + 1;
+    }
+    failed = failed || status < 0 || byteWriterFlush(&writer);
+    free(writer.buff);
+  }
+  if(merged.map){
+    munmap(merged.map, merged.size);
+  }
+  //map the tokens and point the leaves at them, the file goes away once it is unmapped
+  if(!failed && tokenSize > 0){
+    runTokensSize = tokenSize;
+    runTokens = (char *)mmap(NULL, runTokensSize, PROT_READ, MAP_PRIVATE, tokenFD, 0);
+    if(runTokens == MAP_FAILED){
+      runTokens = NULL;
+      failed = 1;
+    }
+    for(i = 0; i < numRunLeaves && !failed; i++){
+      runLeaves[i].key = runTokens + (size_t)runLeaves[i].key;
+    }
+  }
+  if(tokenFD >= 0){
+    close(tokenFD);
+  }
+  if(tokenPath){
+    unlink(tokenPath);
+    free(tokenPath);
+  }
+  if(failed){
+    free(runLeaves);
+    runLeaves = NULL;
+    numRunLeaves = 0;
+  }
+  //the temp file is only needed for loading
+  if(mergedPath && mergedPath != output){
+    unlink(mergedPath);
+    free(mergedPath);
+  }
+  //the escape code takes over the occurrences we didn't load
+  if(!failed && dropped > 0){
+    failed = tableInsert(&vocab, "$e", 2);
+    if(!failed){
+      mapFind(&vocab.table, "$e", 2, hashToken("$e", 2)) -> value += dropped - 1;
+    }
+  }
+  return failed;
+}
+
+/* Reads the given file one chunk at a time and counts its tokens into the vocabulary */
+int fileReader (int fileDescriptor, struct vocabulary * counts){
+  //stream the file through the tokenizer
+  if(mapFile(fileDescriptor, tokenizeChunk, counts)){
+    //print an error
+    printf("ERROR: Unable to read the file\n");
+    return 1;
+  }
+  //finish it
   return 0;
 }
 
-/* Reads the given file and loads it into a local buffer */
-int codebookReader (int fileDescriptor){
-  //buffer size
-  int buffSize = 100;
-  //create the buffer to store the file
-  char *myBuffer = (char *)malloc(101*sizeof(char));
-  //check if the pointer is null
-  if(myBuffer == NULL){
+/* reads the file in CHUNK_SIZE pieces and hands each one to consume(buffer, length, isLast, context).
+consume returns how many bytes it used (or -1 on errors), the rest is moved to the front of the buffer
+and the next chunk is read in after it, so tokens split between chunks are kept whole */
+int streamFile(int fd, int (*consume)(char *, int, int, void *), void * context){
+  //the size of the buffer, it only grows if a single token doesn't fit
+  int cap = CHUNK_SIZE;
+  //the buffer with room for a null terminator
+  char * buff = (char *)malloc(cap+1);
+  //temp for growing the buffer
+  char * temp;
+  //the number of bytes in the buffer
+  int length = 0;
+  //the status of the last read
+  int status = 1;
+  //the number of bytes the consumer used
+  int used;
+  //check for memory
+  if(!buff){
     //print an error
     printf("ERROR: Not enough space on heap\n");
+    return 1;
   }
-  //set everything in the buffer to the null terminator
-  memset(myBuffer, '\0', 101);
-  //store the status of the read
-  int readIn = 0;
-  int status = 1;
-  //temp pointer to hold the dynamically sized buffer
-  char *temp;
-  //loop until everything has been read
-  while(status > 0){ 
-    //read buff size number of chars and store in myBuffer
-    do{
-      status = read(fileDescriptor, myBuffer+readIn, 100);
-      readIn += status;
-    }while(readIn < buffSize && status > 0);
-    //check if there are more chars left
-    if(status > 0){
-      //increase the array size by 100
-      buffSize += 100;
-      //store the old values in the temp pointer
-      temp = myBuffer;
-      //malloc the new array to myBuffer
-      myBuffer = (char *)malloc(buffSize*sizeof(char));
-      //check if the pointer is null
-      if(myBuffer == NULL){
+  //keep going until the consumer has seen the end of the file
+  while(status != 0){
+    //fill up the rest of the buffer
+    while(length < cap && (status = read(fd, buff+length, cap-length)) > 0){
+      length += status;
+    }
+    //check for read errors
+    if(status < 0){
+      free(buff);
+      return 1;
+    }
+    //keep the chunk null terminated
+    buff[length] = '\0';
+    //hand the chunk over, status is 0 once we hit the end of the file
+    used = consume(buff, length, status == 0, context);
+    if(used < 0){
+      free(buff);
+      return 1;
+    }
+    //carry whatever was not used over to the front
+    memmove(buff, buff+used, length-used);
+    length -= used;
+    //a token as big as the whole buffer needs more room
+    if(length == cap){
+      cap *= 2;
+      temp = (char *)realloc(buff, cap+1);
+      if(!temp){
         //print an error
         printf("ERROR: Not enough space on heap\n");
+        free(buff);
+        return 1;
       }
-      //set everything in the buffer to the null terminator
-      memset(myBuffer, '\0', buffSize);
-      //copy the old memory into the new buffer
-      memcpy(myBuffer, temp, readIn);
-      //free the old memory that was allocated
-      free(temp);
-    }
-  }
-  //we hand over the contents of our file (stored in buffer) to the table loader function
-  buildHuffTree(myBuffer, buffSize);
-  //free the buffer once we're done using it
-  free(myBuffer);
-  //finish it
+      buff = temp;
+    }
+  }
+  //we're done with the buffer
+  free(buff);
+  //success!
   return 0;
 }
 
-/* traverse through the given huffman codebook */
-void buildHuffTree(char * myBook, int buffSize){
-  //check to see that we have shit in the buffer
-  if(buffSize == 0){
-    //print an error
-    printf("WARNING: Empty codebook\n");
-    //return unsuccessfull
-    exit(0);
+/* maps a regular file and hands all of it to consume as a single last chunk so nothing is copied onto the heap,
+anything that can't be mapped (pipes, empty or huge files) is streamed with streamFile instead */
+int mapFile(int fd, int (*consume)(char *, int, int, void *), void * context){
+  //the size and type of the file
+  struct stat info;
+  //the mapping
+  char * map;
+  //what the consumer returned
+  int used;
+  //only regular files that fit in a chunk length can be mapped
+  if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0 || info.st_size > INT_MAX){
+    return streamFile(fd, consume, context);
   }
-  //counters
-  int t = 0;
-  int indicator = 0;
-  int localCount = 0;
-  //find the escaping sequence first allocate space for it
-  escapeSequence = (char *) malloc(50*sizeof(char));
-  //throw an error in case this fails
-  if(!escapeSequence){
-    //print an ERROR
-    printf("FATAL ERROR: Not enough space on the heap/n");
-    //return unsuccessful
-    exit(0);
+  //map the whole file read only
+  map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED){
+    return streamFile(fd, consume, context);
   }
-  //memset the escape sequence to be null
-  memset(escapeSequence, '\0', 50);
-  //loop through the characters until you hit the first new line
-  while(myBook[t] != '\n'){
-    //store the characters in the escaping sequence one by one
-    escapeSequence[t] = myBook[t];
-    //increment the counter
-    t++;
-  }
-  //store the path and token
-  char currPath[PATH_MAX+1];
-  //reset the path
-  memset(currPath, '\0', PATH_MAX+1);
-  //malloc the token
-  char * token = (char *)malloc(101*sizeof(char));
-  //temp for increasing the character size
-  char * temp;
-  //set tokens to null
-  memset(token, '\0', 101);
-  //initial token size
-  int tokenSize = 100;
-  //skip the fnewline char at the end of the first line
-  t ++;
-  //loop counter
+  //we read it front to back exactly once
+  madvise(map, info.st_size, MADV_SEQUENTIAL);
+  //the whole file is one chunk
+  used = consume(map, info.st_size, 1, context);
+  //unmap it
+  munmap(map, info.st_size);
+  //check if the consumer failed
+  return used < 0;
+}
+
+/* returns the position just after the last of the given delimiters in the buffer, or 0 if there is none */
+int lastDelimiter(char * buff, int length, char * delimiters){
+  //start from the end
   int i;
-  //now traverse the codebook
-  for(i = t; i < buffSize; i++){
-    //if we hit a tab, switch the indicator to 1
-    if(myBook[i] == '\t'){
-      //start getting the token
-      indicator = 1;
-      //reset localCount and add the null terminator
-      currPath[localCount] = '\0';
-      localCount = 0;
-    } else if(myBook[i] == '\n'){
-      //we don't want to insert empty tokens
-      if(strcmp(token, "") != 0){
-        //add a null terminator just in case
-        token[localCount] = '\0';
-        //insert the token into the appropriate spot of the huffman tree
-        huffInsert(currPath, token, huffHead);
-      }
-      //flip the indicator back
-      indicator = 0;
-      //make a new token
-      token = malloc(101*sizeof(char));
-      //reset token size as well
-      tokenSize = 100;
-      //reset localCount and add the null terminator
-      localCount = 0;
-      //reset the path as well
-      memset(currPath, '\0', PATH_MAX+1);
-    } else if(!indicator){
-      //calculate the path
-      currPath[localCount] = myBook[i];
-      localCount++;
-    } else if(indicator){
-      //check to see if localcount went overboard
-      if(localCount >= tokenSize){
-        //temporily move token to temp
-        temp = token;
-        //malloc more memory to token
-        token = (char *)malloc((tokenSize+101)*sizeof(char));
-        //increase token size
-        tokenSize += 101;
-        //set token to \0
-        memset(token, '\0', tokenSize);
-        //move the temp stuff back into token
-        memcpy(token, temp, tokenSize-100);
-      }
-      //check the escaping sequence
-      if(myBook[i] == escapeSequence[localCount]){
-        //check to see if the rest of the escaping sequence is also present
-        if(strncmp(escapeSequence, &myBook[localCount], strlen(escapeSequence)) == 0){
-          //we need to escape sequence with one of the following
-          if(myBook[i+strlen(escapeSequence)] == 'n'){
-          //store the newline character in cdata
-          token[0] = '\n';
-          //skip the rest of the escape sequence
-          i += strlen(escapeSequence);
-        } else if(myBook[i+strlen(escapeSequence)] == '\n'){
-          //store the space character in cdata
-          token[0] = ' ';
-          //skip the rest of the escape sequence
-          i += strlen(escapeSequence)-1;
-        } else if(myBook[i+strlen(escapeSequence)] == 't'){
-          //store the tab character in cdata
-          token[0] = '\t';
-          //skip the rest of the escape sequence
-          i += strlen(escapeSequence);
-        }
-        }
-      } else{
-        //find the token
-        token[localCount] = myBook[i];
-      }
-      //in any case, increment the local count
-      localCount++;
+  for(i = length-1; i >= 0; i--){
+    //check if this character is one of the delimiters
+    if(buff[i] != '\0' && strchr(delimiters, buff[i])){
+      return i+1;
     }
   }
+  //no delimiter in the whole buffer
+  return 0;
 }
 
-/*Insert the node in the correct part of our huffman tree*/
-int huffInsert(char * currPath, char * token, struct node * curr){
-  //follow the instructions given in the path
-  if(strcmp(currPath, "") == 0){
-    //we have found the node ladies and gents
-    curr -> rChild = NULL;
-    curr -> lChild = NULL;
-    curr ->identifier = 1;
-    curr ->myKey = token;
-  } else{
-    //check to go right or left
-    if(currPath[0] == '0'){
-      //go left, check if it's null
-      if(!(curr -> lChild)){
-        //allocate memory
-        curr -> lChild = (struct node *)malloc(sizeof(struct node));
-        //make sure the that its children are nulled out
-        curr -> lChild -> rChild = NULL;
-        curr -> lChild -> lChild = NULL;
-      }
-      //change path accordingly
-      currPath++;
-      //make sure the identifier signifies a parent
-      curr ->identifier = 0;
-      //recursively call huffInsert
-      huffInsert(currPath, token, curr -> lChild);
-    } else if(currPath[0] == '1'){
-      //we need to go right
-      if(!(curr -> rChild)){
-        //allocate memory
-        curr -> rChild = (struct node *)malloc(sizeof(struct node));
-        //make sure the that its children are nulled out
-        curr -> rChild -> rChild = NULL;
-        curr -> rChild -> lChild = NULL;
-      }
-      //change path accordingly
-      currPath++;
-      //make sure the identifier signifies a parent
-      curr ->identifier = 0;
-      //recursively call huffInsert
-      huffInsert(currPath, token, curr -> rChild);
-    }
+/* picks the widest delimiter scan this machine has, called once before any threads start */
+void pickDelimiterScan(){
+#if defined(__GNUC__) && defined(__x86_64__)
+  if(__builtin_cpu_supports("avx2")){
+    delimiterMask = avx2Delimiters;
+    return;
   }
-  return 0;
+#endif
+#ifdef __SSE2__
+  delimiterMask = sse2Delimiters;
+#else
+  delimiterMask = scalarDelimiters;
+#endif
 }
 
-/* TODO this method traversees the files array and decompresses all of them*/
-int decompressFiles(int numOfFiles){
-  //counter and other stuff
-  int i;
-  char filePath[PATH_MAX+1];
-  char fileType[4];
-  int length;
-  int fd;
-  int writefd;
-  //loop through the files and skip the ones not compressed already
-  for(i = 0; i < numOfFiles; i++){
-    //calculate the index of the point
-    length = strlen(files[i]);
-    //check to see if the path is even valid
-    if(length < 5){
-      continue;
+/* gets the scanner ready for the buffer */
+void scannerInit(struct delimiterScanner * scan, const char * buff, int length){
+  scan -> buff = buff;
+  scan -> length = length;
+  //start one block before the buffer with nothing left in the mask
+  scan -> base = -SCAN_BLOCK;
+  scan -> mask = 0;
+}
+
+/* returns the position of the next delimiter, or the length of the buffer once there are none left */
+int scannerNext(struct delimiterScanner * scan){
+  //the last block is copied here so we never read past the buffer
+  char tail[SCAN_BLOCK];
+  //the position of the delimiter
+  int position;
+  //find the next block with a delimiter in it
+  while(scan -> mask == 0){
+    scan -> base += SCAN_BLOCK;
+    //check if we ran out of blocks
+    if(scan -> base >= scan -> length){
+      return scan -> length;
     }
-    //split the path and type
-    strncpy(fileType, &files[i][length-4], 4);
-    strncpy(filePath, files[i], length-4);
-    //we need to add a null terminator to the filepath
-    filePath[length-4] = '\0';
-    //check if the file is an hcz file
-    if(strcmp(fileType, ".hcz") == 0){
-      //open the huffman codebook file
-      fd = open(files[i], O_RDONLY);
-      //also open the file descriptor to write
-      writefd = open(filePath, O_TRUNC | O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
-      //pass it into the readHcz method to be read
-      readHcz(fd, writefd);
+    if(scan -> length - scan -> base >= SCAN_BLOCK){
+      scan -> mask = delimiterMask(scan -> buff + scan -> base);
+    } else{
+      //pad the last partial block with bytes that are not delimiters
+      memset(tail, 'x', SCAN_BLOCK);
+      memcpy(tail, scan -> buff + scan -> base, scan -> length - scan -> base);
+      scan -> mask = delimiterMask(tail);
     }
   }
-  //success!
-  return 0;
+  //the lowest bit is the next delimiter
+  position = scan -> base + __builtin_ctz(scan -> mask);
+  //clear it so we move on next time
+  scan -> mask &= scan -> mask - 1;
+  return position;
 }
 
-/*Reads the given .hcz file*/
-int readHcz(int readFD, int writeFD){
-  //store the character read from the hcz file
-  char * direction = (char *)malloc(2*sizeof(char));
-  //store the current node
-  struct node * curr = huffHead;
-  //status indicates the number of bits read
-  int status = 1;
-  //loop through the bitcode in the hcz file
-  while(status != 0){
-    //read in a bit and pick the direction
-    status = read(readFD, direction, 1);
-    //check if status is 1
-    if(status == 1){
-      //go down the tree accordingly
-      if(direction[0] == '1'){
-        //we need to go right
-        if(!(curr -> rChild)){
-          //there's something wrong
-          printf("Warning: Codebook mismatch\n");
-          exit(1);
-        }
-        curr = curr -> rChild;
-      } else if(direction[0] == '0'){
-        //we need to go left
-        if(!(curr -> lChild)){
-          //there's something wrong
-          printf("Warning: Codebook mismatch\n");
-          exit(1);
-        }
-        curr = curr -> lChild;
-      }
-      //check to see if you hit a leaf
-      if(curr ->identifier == 1){
-        //we need to write the token to the write fd
-        write(writeFD, curr -> myKey, strlen(curr -> myKey));
-        //reset curr to be the huffman head
-        curr = huffHead;
-      }
+/* marks the spaces, tabs and newlines of a SCAN_BLOCK byte block one byte at a time */
+unsigned int scalarDelimiters(const char * block){
+  //bit i is set when byte i is a delimiter
+  unsigned int mask = 0;
+  int i;
+  for(i = 0; i < SCAN_BLOCK; i++){
+    if(block[i] == ' ' || block[i] == '\t' || block[i] == '\n'){
+      mask |= 1u << i;
     }
   }
-  return status;
+  return mask;
 }
 
-/* writes the codes to a codebook file and frees the tree*/
-int depthFirstSearch(struct node * curr, int fd, char * path){
-  //create a local copy of the path
-  char localPath[PATH_MAX];
-  strcpy(localPath, path);
-  //for some reason if curr is null, gtfo
-  if(!curr){
-    return 0;
+#ifdef __SSE2__
+/* marks the spaces, tabs and newlines of a SCAN_BLOCK byte block 16 bytes at a time */
+unsigned int sse2Delimiters(const char * block){
+  //the two halves of the block
+  __m128i low = _mm_loadu_si128((const __m128i *)block);
+  __m128i high = _mm_loadu_si128((const __m128i *)(block+16));
+  //the characters we split on
+  __m128i space = _mm_set1_epi8(' ');
+  __m128i tab = _mm_set1_epi8('\t');
+  __m128i newline = _mm_set1_epi8('\n');
+  //compare every byte against all three and keep one bit per byte
+  unsigned int lowMask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(low, space), _mm_cmpeq_epi8(low, tab)), _mm_cmpeq_epi8(low, newline)));
+  unsigned int highMask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(high, space), _mm_cmpeq_epi8(high, tab)), _mm_cmpeq_epi8(high, newline)));
+  return lowMask | (highMask << 16);
+}
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+/* marks the spaces, tabs and newlines of a SCAN_BLOCK byte block in one go */
+__attribute__((target("avx2"))) unsigned int avx2Delimiters(const char * block){
+  //the whole block
+  __m256i bytes = _mm256_loadu_si256((const __m256i *)block);
+  //compare every byte against the three characters we split on and keep one bit per byte
+  __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t'))), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+  return (unsigned int)_mm256_movemask_epi8(hits);
+}
+#endif
+
+/* hands the complete tokens of a chunk to the tokenizer, returns how much of the chunk was used */
+int tokenizeChunk(char * buff, int length, int isLast, void * context){
+  //only tokens followed by a delimiter are complete, unless the file is over
+  int end = isLast ? length : lastDelimiter(buff, length, " \t\n");
+  //tokenize the complete part
+  if(tokenizer(buff, end, (struct vocabulary *)context)){
+    return -1;
+  }
+  //the rest is carried over to the next chunk
+  return end;
+}
+
+/* After reading the complete contents of a given file, we need to split the file up into tokens
+and then load each token into the table or update the token's frequency */
+int tokenizer (char *buff, int buffSize, struct vocabulary * counts){
+  //counter to loop through the buffer
+  int counter;
+  //where the current token starts
+  int start = 0;
+  //finds the delimiters a block at a time
+  struct delimiterScanner scan;
+  scannerInit(&scan, buff, buffSize);
+  //jump from delimiter to delimiter
+  while((counter = scannerNext(&scan)) < buffSize){
+    //we don't need to store empty tokens, the token is counted straight out of the buffer
+    if(counter > start && tableInsert(counts, &buff[start], counter-start)){
+      return 1;
+    }
+    //also insert the special terminator character
+    switch(buff[counter]){
+      case '\t':
+        tableInsert(counts, "$t", 2);
+        break;
+      case ' ':
+        tableInsert(counts, "$", 1);
+        break;
+      case '\n':
+        tableInsert(counts, "$n", 2);
+        break;
+    }
+    //the next token starts after it
+    start = counter+1;
+  }
+  //we have reached the end put the last guy in there
+  if(buffSize > start && tableInsert(counts, &buff[start], buffSize-start)){
+    return 1;
   }
-  //check to see if the node has children
-  if(curr->identifier == 1){
-    //if not, we have hit a leaf node write its code
-    write(fd, path, strlen(path));
-    write(fd, "\t", 1);
-    write(fd, curr -> myKey, strlen(curr -> myKey));
-    write(fd, "\n", 1);
-    //free the node!
-    free(curr);
-    //return success
-    return 0;
-  } else{
-    //otherwise we go down the path
-    if(curr->rChild){
-      //copy the path
-      strcpy(localPath, path);
-      //add a 1 to the path
-      strncat(localPath, "1", 1);
-      //go down the right child
-      depthFirstSearch(curr->rChild, fd, localPath);
-    }
-    //go down the leftside
-    if(curr->lChild){
-      //reset the path
-      strcpy(localPath, path);
-      //add a 0 to the path
-      strncat(localPath, "0", 1);
-      //go down the left child
-      depthFirstSearch(curr->lChild, fd, localPath);
-    }
-  }
-  //free the node!
-  free(curr);
-  //return success
   return 0;
 }
 
-/*Start building the Subtrees Tree and free the heap upon completion*/
-int buildSubTrees(){
-  //have a temp node to store the pops
-  struct node * temp1 = NULL;
-  struct node * temp2 = NULL;
-  struct node * parent = NULL;
-  //loop through the original minheap
-  while(myHeap -> used > 1){
-    //check the roots of both heaps
-    temp1 = pop();
-    temp2 = pop();
-    //make the next nodes null
-    temp1 -> next = NULL;
-    temp2 -> next = NULL;
-    //allocate space for a parent node
-    parent = (struct node *)malloc(sizeof(struct node));
-    //initialize the values in the parent
-    parent -> identifier = 0;
-    parent -> myKey = NULL;
-    parent -> next = NULL;
-    parent -> frequency = temp1 -> frequency + temp2 -> frequency;
-    //assign the right and left children of the parent
-    parent -> lChild = temp1;
-    parent -> rChild = temp2;
-    //put the parent back into the heap
-    heapInsert(parent);
-  }
-  //assign huffhead to hold the head of the tree
-  huffHead = myHeap -> arr[0];
-  //get rid of the heap
-  free(myHeap -> arr);
-  free(myHeap);
-  //return success
+/* for every token (a slice of length bytes) find its slot in the table and count it, new tokens are interned in the pool */
+int tableInsert(struct vocabulary * counts, char *token, int length){
+  //the slot of the token
+  struct tableEntry * entry;
+  //whether the token was already in the table
+  int found;
+  //with a memory budget the token goes into the sketch
+  if(counts -> sketch){
+    if(sketchAdd(counts -> sketch, token, length, 1, 0)){
+      printf("ERROR: Not enough space on heap\n");
+      return 1;
+    }
+    return 0;
+  }
+  //find or make the slot for the token
+  entry = mapInsert(&counts -> table, token, length, &found);
+  //check for memory
+  if(!entry){
+    //no space
+    printf("ERROR: Not enough space on heap\n");
+    return 1;
+  }
+  //check if we have seen the token before
+  if(found){
+    //update the frequency
+    entry -> value++;
+  } else{
+    //the slice points into the input, so the table keeps the one copy in the arena
+    entry -> key = arenaString(&counts -> arena, token, length);
+    if(!(entry -> key)){
+      //no space
+      printf("ERROR: Not enough space on heap\n");
+      return 1;
+    }
+    //first time we see it
+    entry -> value = 1;
+    //write the counts out once they take up more memory than we're allowed
+    if(counts -> budget > 0 && counts -> table.cap*(long)sizeof(struct tableEntry) + counts -> arena.size > counts -> budget && spillRun(counts)){
+      printf("FATAL ERROR: Unable to spill the counts to disk\n");
+      exit(1);
+    }
+  }
   return 0;
 }
 
-/* pop's the minimum (root) off of the heap */
-struct node * pop(){
-  //find the node at the top
-  struct node * toPop = myHeap -> arr[0];
-  //replace the root with the lowest node
-  myHeap -> arr[0] = myHeap -> arr[myHeap -> used-1];
-  //make the last node null now that you've moved it
-  myHeap -> arr[myHeap -> used-1] = NULL;
-  //update the used space in the heap
-  myHeap -> used--;
-  //insert the root in the correct position
-  siftDown(myHeap -> arr[0], 0);
-  //return the node that was popped
-  return toPop;
-}
-
-/*TODO: fix for big files sift down the new root until it is at the correct position*/
-int siftDown(struct node * parent, int currPos){
-  //calculate the potential positions
-  int rPos = (currPos*2)+2;
-  int lPos = (currPos*2)+1;
-  //check if we are at the end of the heap
-  while(rPos > myHeap -> cap || lPos > myHeap -> cap){
-    //increase the heap size, this is unlikely tho
-    increaseHeapSize();
-  }
-  //we need to sift up our latest inserted node until its in the right spot
-  struct node * rightChild = myHeap -> arr[rPos];
-  struct node * leftChild = myHeap -> arr[lPos];
-  struct node * temp;
-  //check if the parent is indeed less than the child
-  if(rightChild && rightChild -> frequency < parent -> frequency){
-    //something has to be sifted, figure out what
-    if(rightChild -> frequency <= leftChild -> frequency){
-      //store the parent in temp
-      temp = parent;
-      //reassign the parent
-      myHeap -> arr[currPos] = rightChild;
-      //reassign the child
-      myHeap -> arr[(currPos*2)+2] = temp;
-      //call siftup again to now check the parent
-      siftDown(temp, (currPos*2)+2);
-    } else if (leftChild && leftChild -> frequency < parent -> frequency){
-      //store the parent in temp
-      temp = parent;
-      //reassign the parent
-      myHeap -> arr[currPos] = leftChild;
-      //reassign the child
-      myHeap -> arr[(currPos*2)+1] = temp;
-      //call siftup again to now check the parent
-      siftDown(temp, (currPos*2)+1);
-    }
-  } else if (leftChild && leftChild -> frequency < parent -> frequency){
-      //store the parent in temp
-      temp = parent;
-      //reassign the parent
-      myHeap -> arr[currPos] = leftChild;
-      //reassign the child
-      myHeap -> arr[(currPos*2)+1] = temp;
-      //call siftup again to now check the parent
-      siftDown(temp, (currPos*2)+1);
-    }
-  return currPos;
-}
-
-/*transfers the contents of the hashTable into the heap*/
-int heapTransfer(){
-  //declare counters
-  int i;
-  //store the current struct in the hashtable
-  struct node *temp;
-  //loop through the hash table
-  for(i = 0; i < 256; i++){
-    //check that the start at index i is not null
-    if(hashTable[i]){
-      //assign temp to the start of the table index
-      temp = hashTable[i];
-      //loop through the nodes at each index
-      while(temp != NULL){
-        //insert into the heap
-        heapInsert(temp);
-        //traverse through the linked list
-        temp = temp -> next;
+/* copies the token into the arena with a null terminator and returns the copy, NULL if we are out of memory */
+char * arenaString(struct arena * pool, const char * token, int length){
+  //the copy
+  char * copy;
+  //the size of a new block
+  int size;
+  //temp for growing the block list
+  char ** temp;
+  //start a new block when the token doesn't fit in what's left
+  if(length+1 > pool -> left){
+    //tokens bigger than a block get a block of their own
+    size = length+1 > ARENA_BLOCK_SIZE ? length+1 : ARENA_BLOCK_SIZE;
+    //make room in the block list
+    if(pool -> numBlocks == pool -> blockCap){
+      pool -> blockCap = pool -> blockCap ? pool -> blockCap*2 : 16;
+      temp = (char **)realloc(pool -> blocks, pool -> blockCap*sizeof(char *));
+      if(!temp){
+        return NULL;
       }
+      pool -> blocks = temp;
     }
+    pool -> next = (char *)malloc(size);
+    if(!(pool -> next)){
+      pool -> left = 0;
+      return NULL;
+    }
+    pool -> blocks[pool -> numBlocks++] = pool -> next;
+    pool -> left = size;
+    pool -> size += size;
   }
-  //return success!
-  return 0;
+  //copy the token over
+  copy = pool -> next;
+  memcpy(copy, token, length);
+  copy[length] = '\0';
+  pool -> next += length+1;
+  pool -> left -= length+1;
+  return copy;
 }
 
-/*increases the heap array size by 100*/
-int increaseHeapSize(){
-  //first store the old array in a temp
-  struct node ** temp = myHeap -> arr;
-  //then mallocate a new array
-  myHeap -> arr = malloc(((myHeap -> cap)+100)*sizeof(struct node *));
-  //set the memory to all zeros
-  memset(myHeap -> arr, 0x0, (myHeap -> cap+100)*sizeof(struct node *));
-  //copy the temp back into the main memory
-  memcpy(myHeap -> arr, temp, (myHeap -> cap)*sizeof(struct node *));
-  //increase the capacity by 100
-  myHeap -> cap += 100;
-  //return the new capacity
-  return myHeap -> cap;
-}
-
-int siftUp(struct node * child, int currPos){
-  //calculate the potential position of the parent
-  int parentPos = (currPos-1)/2;
-  //check if the parent position is less than 0 or if both curr and parent are zero
-  if(parentPos == 0 && currPos == 0){
-    //we have gone as high as we could have
-    return 0;
+/* frees every block of the arena, and with them every string handed out */
+void arenaFree(struct arena * pool){
+  //loop counter
+  int i;
+  for(i = 0; i < pool -> numBlocks; i++){
+    free(pool -> blocks[i]);
   }
-  //we need to sift up our latest inserted node until its in the right spot
-  struct node * parent = myHeap -> arr[(currPos-1)/2];
-  struct node * temp;
-  //check if the parent is indeed less than the child
-  if(parent -> frequency > child -> frequency){
-    //store the parent in temp
-    temp = parent;
-    //reassign the parent
-    myHeap -> arr[(currPos-1)/2] = child;
-    //reassign the child
-    myHeap -> arr[currPos] = temp;
-    //call siftup again to now check the parent
-    siftUp(child, (currPos-1)/2);
-  }
-  //return the new position
-  return (currPos-1)/2;
-}
-
-/*print heap function (purely for testing)*/
-void printHeap(){
-  //counter
-  int k = 0;
-  int myfd = open("tableContents.txt", O_WRONLY);
-  char snum[15];
-  //loop through the heap used
-  for(k = 0; k < myHeap -> used; k++){
-    sprintf(snum,"%d" ,myHeap -> arr[k] -> frequency);
-    write(myfd, myHeap -> arr[k] -> myKey, strlen(myHeap -> arr[k] -> myKey));
-    write(myfd, "\t", 1);
-    write(myfd, snum, strlen(snum));
-    write(myfd, "\n", 1);
-    //printf("%s %d %d \n",myHeap -> arr[k] -> myKey, myHeap -> arr[k] -> identifier, myHeap -> arr[k] -> frequency);
-  } 
-  printf("\n");
-  close(myfd);
+  free(pool -> blocks);
+  memset(pool, 0x0, sizeof(struct arena));
 }
 
-int heapInsert(struct node * toInsert){
-  //check if there is space to insert the node
-  if(myHeap -> used >= myHeap -> cap){
-    //increase the heap size
-    increaseHeapSize();
+/* makes an empty table with cap slots (a power of two) */
+int mapInit(struct hashMap * map, int cap){
+  //every slot starts out empty
+  map -> slots = (struct tableEntry *)calloc(cap, sizeof(struct tableEntry));
+  if(!(map -> slots)){
+    return 1;
   }
-  //insert the node at the end of the array and sift up accordingly
-  myHeap -> arr[myHeap -> used] = toInsert;
-  //sift up the last node accordingly
-  siftUp(toInsert, myHeap -> used);
-  //increment the used space
-  myHeap -> used++;
-  //printHeap();
-  //increment the used space
-  return myHeap -> used;
+  map -> cap = cap;
+  map -> used = 0;
+  //success!
+  return 0;
 }
 
-/* given a directory stream, traverses the directory/files and stores in the files array */
-int direcTraverse (DIR *myDirectory, int counter, int currSize, char * currDirec){
-  //stores the filepath of our subdirectories
-  char filePBuff[PATH_MAX + 1];
-  //in the case of recursion, update the filepath so that we do not get lost
-  strcpy(filePBuff, currDirec);
-  //add a forward-slash at the end to get ready to add more to the path
-  strcat(filePBuff, "/");
-  //the dirent struct which holds whatever readdir returns
-  struct dirent *currDir;
-  //loop through the contents of the directory and store in files array
-  while((currDir = readdir(myDirectory)) != NULL){
-    //skip the . and .. and dsstore file
-    if(strcmp(currDir->d_name, ".") == 0 || strcmp(currDir->d_name, "..") == 0 || strcmp(currDir->d_name,".DS_Store") == 0){
-      //skip the iteration
-      continue;
+/* returns the slot holding the key, or the empty slot where it would go */
+struct tableEntry * mapFind(struct hashMap * map, const char * key, int keyLen, uint32_t hash){
+  //mask for wrapping around the table
+  int mask = map -> cap - 1;
+  //the slot we are looking at
+  int slot = hash & mask;
+  //the entry in the slot
+  struct tableEntry * entry;
+  //probe until we find the key or an empty slot
+  while((entry = &(map -> slots[slot])) -> key){
+    //only compare the bytes when the hash and length match
+    if(entry -> hash == hash && entry -> keyLen == keyLen && memcmp(entry -> key, key, keyLen) == 0){
+      return entry;
     }
-    //first check if the currdir is a regular file or a directory
-    if(currDir->d_type == DT_DIR){
-      //add the directory in question to the path
-      strcat(filePBuff, currDir->d_name);
-      //traverse the new directory
-      counter = direcTraverse(opendir(filePBuff), counter, currSize, filePBuff);
-      //we are back in the original file, get rid of the previous file path
-      strcpy(filePBuff, currDirec);
-      //put the forward-slash back in there
-      strcat(filePBuff, "/");
-      //find the new max size of the array
-      currSize = ((counter%100)+1)*100;
-    } else if(currDir -> d_type == DT_REG){
-      //allocate space for the file path
-      files[counter] = (char *)malloc((PATH_MAX+1) * sizeof(char));
-      //add the file path to the array
-      strcpy(files[counter],filePBuff);
-      //store the names of the files in our files array
-      strcat(files[counter], currDir->d_name);
-      //just to test the code
-      //printf("%s\n", files[counter]);
-      //check if files array needs more space
-      if(++counter >= currSize){
-        //realloc 100 more spaces in our files array
-        files = realloc(files, (currSize+100) * sizeof(char *));
-        //check is the given file exists
-        if(!files){
-          //file does not exist it is a fatal error
-          printf("FATAL ERROR: Not enough memory\n");
-          //exit the code
-          exit(1);
-        }
-        //change the curr size accordingly
-        currSize += 100;
-      }
+    slot = (slot + 1) & mask;
+  }
+  //the key is not in the table
+  return entry;
+}
+
+/* finds the slot of the key, claiming an empty one for it (with key stored as given) if it is not there yet.
+found is set to 1 when the key was already there. Returns NULL if we ran out of memory */
+struct tableEntry * mapInsert(struct hashMap * map, char * key, int keyLen, int * found){
+  //the hash of the key
+  uint32_t hash = hashToken(key, keyLen);
+  //the slot of the key
+  struct tableEntry * entry = mapFind(map, key, keyLen, hash);
+  //check if the key is already there
+  if(entry -> key){
+    *found = 1;
+    return entry;
+  }
+  *found = 0;
+  //keep the table at most 3/4 full so probes stay short
+  if((map -> used + 1)*4 > map -> cap*3){
+    if(mapGrow(map)){
+      return NULL;
     }
+    //find the empty slot again in the bigger table
+    entry = mapFind(map, key, keyLen, hash);
   }
-  //return the current count
-  return counter;
+  //claim the slot
+  entry -> key = key;
+  entry -> keyLen = keyLen;
+  entry -> hash = hash;
+  entry -> value = 0;
+  entry -> bits = 0;
+  map -> used++;
+  return entry;
 }
 
-/* free the files array */
-void freeFiles(int numberOfFiles){
-  //counter
+/* doubles the number of slots and moves every entry over using its stored hash */
+int mapGrow(struct hashMap * map){
+  //the old slots
+  struct tableEntry * old = map -> slots;
+  int oldCap = map -> cap;
+  //loop counter
   int i;
-  //no need to loop is there is only one file
-  if(numberOfFiles > 1){
-    //loop through the files array and free em all
-    for(i = 0; i < numberOfFiles; i++){
-      //free file at i
-      free(files[i]);
+  //the slot an entry moves to
+  int slot;
+  //make the new slots
+  if(mapInit(map, oldCap*2)){
+    map -> slots = old;
+    map -> cap = oldCap;
+    return 1;
+  }
+  //move every entry over
+  for(i = 0; i < oldCap; i++){
+    if(old[i].key){
+      slot = old[i].hash & (map -> cap - 1);
+      while(map -> slots[slot].key){
+        slot = (slot + 1) & (map -> cap - 1);
+      }
+      map -> slots[slot] = old[i];
+      map -> used++;
     }
   }
-  //free the files array itself
-  free(files);
+  //free the old slots
+  free(old);
+  //success!
+  return 0;
 }
 
+/* frees the slots of the table, the keys belong to the caller */
+void mapFree(struct hashMap * map){
+  free(map -> slots);
+  map -> slots = NULL;
+  map -> cap = 0;
+  map -> used = 0;
+}
 
-/* iterates through the files and first calls file reader on each file */
-int buildCodebook (int filesSize){
-  //random local variables
-  int counter;
-  //loop through the files array
-  for(counter = 0; counter < filesSize; counter++){
-    //open the file at the specific index to a read only mode
-    int fd = open(files[counter], O_RDONLY);
-    //check is the given file exists
-    if(fd < 0){
-      //file does not exist it is a fatal error
-      printf("FATAL ERROR: File does not exist\n");
-      //exit the code
-      exit(1);
+/* empties the slot of the entry, moving later entries of its probe run back so every key can still be found */
+void mapRemove(struct hashMap * map, struct tableEntry * entry){
+  //mask for wrapping around the table
+  int mask = map -> cap - 1;
+  //the slot being emptied, the slot after it and where that slot's key wants to be
+  int hole = entry - map -> slots;
+  int next = hole;
+  int home;
+  while(1){
+    next = (next + 1) & mask;
+    //the run ends at the first empty slot
+    if(!map -> slots[next].key){
+      break;
     }
-    //hand the fd over to the build frequencies method to update our hash table
-    fileReader(fd);
-    //close the file descriptor once you are done with it
-    close(fd);
+    //keys that belong between the hole and where they are have to stay put
+    home = map -> slots[next].hash & mask;
+    if(hole <= next ? (hole < home && home <= next) : (hole < home || home <= next)){
+      continue;
+    }
+    //move the key into the hole, its old slot is the new hole
+    map -> slots[hole] = map -> slots[next];
+    hole = next;
   }
+  map -> slots[hole].key = NULL;
+  map -> used--;
+}
 
+/* gives the vocabulary a sketch with as many counters as fit in about budget bytes */
+int sketchInit(struct vocabulary * counts, long budget){
+  //the sketch
+  struct sketch * sketch;
+  //the number of counters and the slots of their table
+  long cap = budget / (long)(sizeof(struct sketchCounter) + sizeof(int) + 2*sizeof(struct tableEntry) + SKETCH_TOKEN_BYTES);
+  int slots = 1;
+  //we need at least one counter
+  if(cap < 1){
+    return 1;
+  }
+  if(cap > INT_MAX/4){
+    cap = INT_MAX/4;
+  }
+  //the table stays at most half full, so it never has to grow
+  while(slots < 2*cap){
+    slots *= 2;
+  }
+  sketch = (struct sketch *)calloc(1, sizeof(struct sketch));
+  if(!sketch){
+    return 1;
+  }
+  sketch -> counters = (struct sketchCounter *)malloc(cap*sizeof(struct sketchCounter));
+  sketch -> heap = (int *)malloc(cap*sizeof(int));
+  if(!(sketch -> counters) || !(sketch -> heap) || mapInit(&sketch -> table, slots)){
+    return 1;
+  }
+  sketch -> cap = cap;
+  counts -> sketch = sketch;
   return 0;
 }
 
-/* Reads the given file and loads it into a local buffer */
-int fileReader (int fileDescriptor){
-  //buffer size
-  int buffSize = 100;
-  //create the buffer to store the file
-  char *myBuffer = (char *)malloc(101*sizeof(char));
-  //check if the pointer is null
-  if(myBuffer == NULL){
-    //print an error
-    printf("ERROR: Not enough space on heap\n");
+/* counts weight more occurrences of the token (a slice of length bytes) of which error may be overcounted,
+taking over the smallest counter if it is new and the sketch is full */
+int sketchAdd(struct sketch * sketch, const char * token, int length, long weight, long error){
+  //the hash of the token and its slot
+  uint32_t hash = hashToken(token, length);
+  struct tableEntry * entry = mapFind(&sketch -> table, token, length, hash);
+  //the counter of the token
+  int c;
+  //whether the slot was already taken
+  int found;
+  //tokens we are counting just get more
+  if(entry -> key){
+    c = entry -> value;
+    sketch -> counters[c].count += weight;
+    sketch -> counters[c].error += error;
+    sketchSift(sketch, sketch -> counters[c].heapPos);
+    return 0;
   }
-  //set everything in the buffer to the null terminator
-  memset(myBuffer, '\0', 101);
-  //store the status of the read
-  int readIn = 0;
-  int status = 1;
-  //temp pointer to hold the dynamically sized buffer
-  char *temp;
-  //loop until everything has been read
-  while(status > 0){ 
-    //read buff size number of chars and store in myBuffer
-    do{
-      status = read(fileDescriptor, myBuffer+readIn, 100);
-      readIn += status;
-    }while(readIn < buffSize && status > 0);
-    //check if there are more chars left
-    if(status > 0){
-      //increase the array size by 100
-      buffSize += 100;
-      //store the old values in the temp pointer
-      temp = myBuffer;
-      //malloc the new array to myBuffer
-      myBuffer = (char *)malloc(buffSize*sizeof(char));
-      //check if the pointer is null
-      if(myBuffer == NULL){
-        //print an error
-        printf("ERROR: Not enough space on heap\n");
-      }
-      //set everything in the buffer to the null terminator
-      memset(myBuffer, '\0', buffSize);
-      //copy the old memory into the new buffer
-      memcpy(myBuffer, temp, readIn);
-      //free the old memory that was allocated
-      free(temp);
-    }
+  //use a free counter while there is one
+  if(sketch -> used < sketch -> cap){
+    c = sketch -> used++;
+    sketch -> counters[c].count = 0;
+    sketch -> counters[c].error = 0;
+    sketch -> counters[c].heapPos = c;
+    sketch -> heap[c] = c;
+  } else{
+    //otherwise take over the smallest one, the new token keeps its count as the benefit of the doubt
+    c = sketch -> heap[0];
+    sketch -> counters[c].error = sketch -> counters[c].count;
+    mapRemove(&sketch -> table, mapFind(&sketch -> table, sketch -> counters[c].key, sketch -> counters[c].keyLen, hashToken(sketch -> counters[c].key, sketch -> counters[c].keyLen)));
+    free(sketch -> counters[c].key);
   }
-  //we hand over the contents of our file (stored in buffer) to the table loader function
-  tokenizer(myBuffer, buffSize);
-  //finish it
+  //the counter gets its own copy of the token
+  sketch -> counters[c].key = (char *)malloc(length+1);
+  if(!(sketch -> counters[c].key)){
+    return 1;
+  }
+  memcpy(sketch -> counters[c].key, token, length);
+  sketch -> counters[c].key[length] = '\0';
+  sketch -> counters[c].keyLen = length;
+  sketch -> counters[c].count += weight;
+  sketch -> counters[c].error += error;
+  //point the token at its counter, the table is never more than half full
+  entry = mapInsert(&sketch -> table, sketch -> counters[c].key, length, &found);
+  entry -> value = c;
+  //put the counter where it belongs in the heap
+  sketchSift(sketch, sketch -> counters[c].heapPos);
   return 0;
 }
 
-/* After reading the complete contents of a given file, we need to split the file up into tokens
-and then load each token into the table or update the token's frequency */
-int tokenizer (char *buff, int buffSize){
-  //counter to loop through the buffer
-  int counter = 0;
-  //counter to loop through the cdata
-  int localcount = 0;
-  char ctemp;
-  //allocate starting space into cdata
-  char *cdata = (char *)malloc(11*sizeof(char));
-  char *temp;
-  //check if the pointer is null
-  if(cdata == NULL){
-    //print an error
-    printf("ERROR: Not enough space on heap\n");
+/* moves the counter at heap position pos up or down until the heap is in order again */
+void sketchSift(struct sketch * sketch, int pos){
+  //the counter being moved and its count
+  int c = sketch -> heap[pos];
+  long count = sketch -> counters[c].count;
+  //the parent or the smaller child
+  int other;
+  //move up past bigger parents
+  while(pos > 0 && sketch -> counters[sketch -> heap[(pos-1)/2]].count > count){
+    other = (pos-1)/2;
+    sketch -> heap[pos] = sketch -> heap[other];
+    sketch -> counters[sketch -> heap[pos]].heapPos = pos;
+    pos = other;
   }
-  //set the array to be all null terminators
-  memset(cdata, '\0', 11);
-  //current size of cdata
-  int currSize = 10;
-  //loop through the string until we hit a comma or terminator
-  while(buff[counter] != '\0'){
-    ctemp = buff[counter];
-    //check if we have hit a space
-    if(ctemp == '\t' || ctemp == ' ' || ctemp == '\n'){
-      //we don't need to store empty tokens
-      if(strcmp(cdata, "") != 0){
-        //isolate the token and insert it into the table
-        tableInsert(cdata);
-        //allocate a new cdata for the next token
-        cdata = (char *)malloc(11*sizeof(char));
-        //set the array to be all null terminators
-        memset(cdata, '\0', 11);
-        //reset the curr size
-        currSize = 10;
-      }
-      //reset the local count
-      localcount = -1;
-      //also insert the special terminator character
-      switch(ctemp){
-        case '\t':
-          tableInsert("$t");
-          break;
-        case ' ':
-          tableInsert("$");
-          break;
-        case '\n':
-          tableInsert("$n");
-          break;
-      }
-    }
-    //store the character in the node array
-    else if(localcount >= currSize-1){
-      //make the cdata array 10 characters bigger
-      currSize += 10;
-      //store the old values in the temp pointer
-      temp = cdata;
-      //malloc the new array to myBuffer
-      cdata = (char *)malloc(currSize*sizeof(char));
-      //check if the pointer is null
-      if(cdata == NULL){
-        //print an error
-        printf("ERROR: Not enough space on heap\n");
-      }
-      //set the random stuff to null terminators again
-      memset(cdata, '\0', currSize);
-      //copy the old memory into the new buffer
-      memcpy(cdata, temp, localcount);
-      //free the old variable
-      free(temp);
-      //store the buffer char
-      cdata[localcount] = buff[counter];
-    } else{
-      //store the buffer character into the cdata character
-      cdata[localcount] = buff[counter];
+  //move down past smaller children
+  while(2*pos+1 < sketch -> used){
+    other = 2*pos+1;
+    if(other+1 < sketch -> used && sketch -> counters[sketch -> heap[other+1]].count < sketch -> counters[sketch -> heap[other]].count){
+      other++;
     }
-    //increment counters
-    counter++;
-    localcount++;
-  }
-  //we have reached the end put the last guy in there
-  if(buff[counter] == '\0'){
-    //check to see if cdata is empty we don't want to unput empty strings
-    if(strcmp(cdata, "") != 0){
-      //isolate the token and insert it into the table
-      tableInsert(cdata);
+    if(sketch -> counters[sketch -> heap[other]].count >= count){
+      break;
     }
+    sketch -> heap[pos] = sketch -> heap[other];
+    sketch -> counters[sketch -> heap[pos]].heapPos = pos;
+    pos = other;
   }
-  return 0;
+  sketch -> heap[pos] = c;
+  sketch -> counters[c].heapPos = pos;
 }
 
-/* for every token find its hash code and insert it into the table accordingly */
-int tableInsert(char *token){
-  //calculate the hash code
-  int sum = 0;
-  int k;
-  //loop through the characters of the token
-  for (k = 0; k < strlen(token); k++){
-    //calculate the ascii sum of the token
-    sum = sum + (int)token[k];
-  }
-  //mod it to fit inside the 256 length array
-  int index = sum % 256;
-  //error check the index
-  if(index < 0){
-    //make the index positive
-    index *= -1;
-  }
-  //check to see if the head node of the given index is Null
-  if(hashTable[index] == NULL){
-    //create a new node and put er in there
-    struct node * newNode = (struct node *)malloc(sizeof(struct node));
-    //populate the node's values
-    newNode -> identifier = 1;
-    newNode -> myKey = token;
-    newNode -> frequency = 1;
-    newNode -> next = NULL;
-    newNode -> rChild = NULL;
-    newNode -> lChild = NULL;
-    //store the newly created node in the table
-    hashTable[index] = newNode;
-    //gtfo
+/* moves the counts of the sketch into the table of the vocabulary and frees the sketch, does nothing without one.
+Only the part of a count we are sure of is kept, tokens that may never have been seen more than the ones they took over are dropped */
+int sketchUnload(struct vocabulary * counts){
+  //the sketch
+  struct sketch * sketch = counts -> sketch;
+  //the occurrences we don't keep, each of them will be written with the escape code
+  long dropped = 0;
+  //loop counter
+  int i;
+  if(!sketch){
     return 0;
-  } else{
-    //curr node to loop through the list of nodes
-    struct node * curr = hashTable[index];
-    //there already exists a headnode and we must loop through to find out token
-    while(curr != NULL){
-      //check if curr is our token
-      if(strcmp(curr -> myKey, token) == 0){
-        //update the frequency and gtfo
-        curr -> frequency++;
-        return 0;
-      } else{
-        if(curr -> next == NULL){
-          //create a new node and put er in there
-          curr -> next = (struct node *)malloc(sizeof(struct node));
-          //increment curr
-          curr = curr -> next;
-          //populate the node's values
-          curr -> identifier = 1;
-          curr -> myKey = token;
-          curr -> frequency = 1;
-          curr -> next = NULL;
-          curr -> rChild = NULL;
-          curr -> lChild = NULL;
-          //gtfo
-          return 0;
-        }
-        //increment curr
-        curr = curr -> next;
-      }
+  }
+  //from here on tokens are counted in the table
+  counts -> sketch = NULL;
+  for(i = 0; i < sketch -> used; i++){
+    //skip the tokens we can't vouch for
+    dropped += sketch -> counters[i].count < sketch -> counters[i].error ? sketch -> counters[i].count : sketch -> counters[i].error;
+    if(sketch -> counters[i].count <= sketch -> counters[i].error){
+      continue;
+    }
+    if(tableInsert(counts, sketch -> counters[i].key, sketch -> counters[i].keyLen)){
+      return 1;
+    }
+    //tableInsert counted it once
+    mapFind(&counts -> table, sketch -> counters[i].key, sketch -> counters[i].keyLen, hashToken(sketch -> counters[i].key, sketch -> counters[i].keyLen)) -> value += sketch -> counters[i].count - sketch -> counters[i].error - 1;
+  }
+  sketchFree(sketch);
+  //the escape code takes over the occurrences we dropped
+  if(dropped > 0){
+    if(tableInsert(counts, "$e", 2)){
+      return 1;
     }
+    mapFind(&counts -> table, "$e", 2, hashToken("$e", 2)) -> value += dropped - 1;
   }
   return 0;
 }
 
+/* frees the sketch and every token in it */
+void sketchFree(struct sketch * sketch){
+  //loop counter
+  int i;
+  if(!sketch){
+    return;
+  }
+  for(i = 0; i < sketch -> used; i++){
+    free(sketch -> counters[i].key);
+  }
+  mapFree(&sketch -> table);
+  free(sketch -> counters);
+  free(sketch -> heap);
+  free(sketch);
+}
+
 /*print the table only to check the frequencies of everything*/
 int printTable(){
   //declare counters
   int i;
-  struct node *temp;
   int myfd = open("tableContents.txt", O_WRONLY);
   char snum[15];
   //loop through the hash table
-  for(i = 0; i < 256; i++){
-    //check that the start at index i is not null
-    if(hashTable[i]){
-      //assign temp to the start of the table index
-      temp = hashTable[i];
-      //loop through the nodes at each index
-      while(temp != NULL){
-        sprintf(snum,"%d" ,temp -> frequency);
-        write(myfd, temp -> myKey, strlen(temp -> myKey));
-        write(myfd, "\t", 1);
-        write(myfd, snum, strlen(snum));
-        write(myfd, "\n", 1);
-        //traverse
-        temp = temp -> next;
-      }
+  for(i = 0; i < vocab.table.cap; i++){
+    //check that the slot at index i is used
+    if(vocab.table.slots[i].key){
+      sprintf(snum,"%ld" ,vocab.table.slots[i].value);
+      write(myfd, vocab.table.slots[i].key, vocab.table.slots[i].keyLen);
+      write(myfd, "\t", 1);
+      write(myfd, snum, strlen(snum));
+      write(myfd, "\n", 1);
     }
   }
   close(myfd);